@@ -7,6 +7,7 @@ module Main ( main ) where
 
 import Criterion.Main
 import qualified Language.Souffle.Compiled as S
+import qualified Language.Souffle.Interpreted as I
 import qualified Data.Text as T
 import qualified Data.Vector as V
 import GHC.Generics
@@ -15,6 +16,7 @@ import Data.Int
 import Control.Monad
 import Control.Monad.IO.Class
 import Control.DeepSeq
+import Foreign.C.Types
 
 
 data Benchmarks = Benchmarks
@@ -68,6 +70,9 @@ main = defaultMain
      $ roundTripBenchmarks
     ++ serializationBenchmarks
     ++ deserializationBenchmarks
+    ++ interpretedSerializationBenchmarks
+    ++ relationLookupBenchmarks
+    ++ relationScanBenchmarks
 
 roundTripBenchmarks :: [Benchmark]
 roundTripBenchmarks =
@@ -181,3 +186,72 @@ deserializationBenchmarks =
     , bench "10000"  $ nfIO $ deserializeWithStrings 10000
     ]
   ]
+
+serializeInterpreted :: (S.ContainsInputFact Benchmarks a, S.Fact a)
+                     => V.Vector a -> IO ()
+serializeInterpreted vec = do
+  cfg <- I.defaultConfig
+  let cfg' = cfg { I.cfgDatalogDir = "benchmarks/fixtures" }
+  I.runSouffleWith cfg' Benchmarks $ \case
+    Nothing -> liftIO $ print "Failed to load interpreted serialize benchmarks!"
+    Just prog -> I.addFacts prog vec
+    -- No run needed
+
+interpretedSerializationBenchmarks :: [Benchmark]
+interpretedSerializationBenchmarks =
+  [ bgroup "serializing facts, interpreted (without strings)"
+    [ bench "1"      $ nfIO $ serializeInterpreted $ mkVec 1
+    , bench "100"    $ nfIO $ serializeInterpreted $ mkVec 100
+    , bench "10000"  $ nfIO $ serializeInterpreted $ mkVec 10000
+    , bench "1000000" $ nfIO $ serializeInterpreted $ mkVec 1000000
+    ]
+  , bgroup "serializing facts, interpreted (with strings)"
+    [ bench "1"      $ nfIO $ serializeInterpreted $ mkVecStr 1
+    , bench "100"    $ nfIO $ serializeInterpreted $ mkVecStr 100
+    , bench "10000"  $ nfIO $ serializeInterpreted $ mkVecStr 10000
+    , bench "1000000" $ nfIO $ serializeInterpreted $ mkVecStr 1000000
+    ]
+  ]
+  where mkVec count = V.generate count $ \i -> NumbersFact (fromIntegral i) (-42) 3.14
+        mkVecStr count = V.generate count $ \i -> StringsFact (fromIntegral i) "abcdef" (-42) 3.14
+
+-- See benchmarks/fixtures/relation_lookups.cpp
+foreign import ccall unsafe "bench_btree_lookups" btreeLookups
+  :: CSize -> IO CSize
+
+foreign import ccall unsafe "bench_hash_lookups" hashLookups
+  :: CSize -> IO CSize
+
+foreign import ccall unsafe "bench_btree_scan" btreeScan
+  :: CSize -> IO CSize
+
+foreign import ccall unsafe "bench_array_scan" arrayScan
+  :: CSize -> IO CSize
+
+relationLookupBenchmarks :: [Benchmark]
+relationLookupBenchmarks =
+  [ bgroup "relation lookups (btree_set)"
+    [ bench "1000"    $ whnfIO $ btreeLookups 1000
+    , bench "100000"  $ whnfIO $ btreeLookups 100000
+    , bench "1000000" $ whnfIO $ btreeLookups 1000000
+    ]
+  , bgroup "relation lookups (t_hash)"
+    [ bench "1000"    $ whnfIO $ hashLookups 1000
+    , bench "100000"  $ whnfIO $ hashLookups 100000
+    , bench "1000000" $ whnfIO $ hashLookups 1000000
+    ]
+  ]
+
+relationScanBenchmarks :: [Benchmark]
+relationScanBenchmarks =
+  [ bgroup "relation scans (btree_set)"
+    [ bench "1000000"   $ whnfIO $ btreeScan 1000000
+    , bench "10000000"  $ whnfIO $ btreeScan 10000000
+    --, bench "100000000" $ whnfIO $ btreeScan 100000000
+    ]
+  , bgroup "relation scans (flat array, baseline)"
+    [ bench "1000000"   $ whnfIO $ arrayScan 1000000
+    , bench "10000000"  $ whnfIO $ arrayScan 10000000
+    --, bench "100000000" $ whnfIO $ arrayScan 100000000
+    ]
+  ]
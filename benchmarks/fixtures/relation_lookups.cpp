@@ -0,0 +1,104 @@
+// Micro-benchmarks for the relation datastructures: exact lookups in a B-tree
+// and a hash relation, and full scans of a B-tree compared to a flat array.
+// Used by the "relation lookups" and "relation scans" benchmarks in bench.hs.
+
+#include "souffle/CompiledSouffle.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+using t_tuple = souffle::Tuple<souffle::RamDomain, 2>;
+using t_btree = souffle::btree_set<t_tuple>;
+using t_hash = souffle::t_hash<2>;
+
+// Relations are only filled once per size, so only lookups are measured.
+template <typename RelType>
+const RelType& filled_relation(size_t count)
+{
+    static std::map<size_t, std::unique_ptr<RelType>> relations;
+    auto& relation = relations[count];
+    if (!relation)
+    {
+        relation = std::make_unique<RelType>();
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto value = static_cast<souffle::RamDomain>(i);
+            relation->insert(t_tuple{{value, value * 7}});
+        }
+    }
+    return *relation;
+}
+
+// Looks up "count" facts that are part of the relation, and "count" facts
+// that are not. Returns the amount of facts that were found.
+template <typename RelType>
+size_t lookups(size_t count)
+{
+    const auto& relation = filled_relation<RelType>(count);
+    size_t found = 0;
+    for (size_t i = 0; i < 2 * count; ++i)
+    {
+        const auto value = static_cast<souffle::RamDomain>(i);
+        found += relation.contains(t_tuple{{value, value * 7}});
+    }
+    return found;
+}
+
+// Sums up all values in the relation, to make sure every tuple is visited.
+template <typename RelType>
+size_t scan(size_t count)
+{
+    const auto& relation = filled_relation<RelType>(count);
+    size_t sum = 0;
+    for (const auto& tuple: relation)
+    {
+        sum += static_cast<size_t>(tuple[0]) + static_cast<size_t>(tuple[1]);
+    }
+    return sum;
+}
+
+}  // namespace
+
+extern "C"
+{
+    size_t bench_btree_lookups(size_t count)
+    {
+        return lookups<t_btree>(count);
+    }
+
+    size_t bench_hash_lookups(size_t count)
+    {
+        return lookups<t_hash>(count);
+    }
+
+    size_t bench_btree_scan(size_t count)
+    {
+        return scan<t_btree>(count);
+    }
+
+    // Baseline: scanning the same amount of tuples, stored contiguously.
+    size_t bench_array_scan(size_t count)
+    {
+        static std::map<size_t, std::vector<t_tuple>> arrays;
+        auto& array = arrays[count];
+        if (array.size() != count)
+        {
+            array.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const auto value = static_cast<souffle::RamDomain>(i);
+                array.push_back(t_tuple{{value, value * 7}});
+            }
+        }
+
+        size_t sum = 0;
+        for (const auto& tuple: array)
+        {
+            sum += static_cast<size_t>(tuple[0]) + static_cast<size_t>(tuple[1]);
+        }
+        return sum;
+    }
+}
@@ -1,10 +1,21 @@
 #include "souffle/SouffleInterface.h"
 #include "souffle.h"
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <string>
+#include <numeric>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <random>
 
 #ifndef ESTIMATED_AVERAGE_STRING_SIZE
 #define ESTIMATED_AVERAGE_STRING_SIZE 32
@@ -12,6 +23,9 @@
 #ifndef GROW_FACTOR
 #define GROW_FACTOR 2
 #endif
+#ifndef DIFF_CHUNK_SIZE
+#define DIFF_CHUNK_SIZE 65536
+#endif
 
 extern "C"
 {
@@ -47,10 +61,442 @@ public:
     }
 };
 
+// A blocked Bloom filter: every tuple sets a few bits within a single
+// cache line, so a lookup touches only one cache line.
+struct bloom_filter
+{
+private:
+    using block_t = std::array<uint64_t, 8>;
+
+    static constexpr size_t BITS_PER_TUPLE = 10;
+    static constexpr size_t HASH_COUNT = 6;
+
+    std::vector<block_t> m_blocks;
+    size_t m_capacity = 0;
+    // Amount of tuples added to the filter. This is tracked here instead of
+    // calling Relation::size() on every lookup, which walks the entire B-tree.
+    size_t m_count = 0;
+    // Cleared when the relation changes in a way the filter didn't track.
+    bool m_valid = false;
+
+public:
+    static uint64_t hash(const souffle::tuple& tuple)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < tuple.size(); ++i)
+        {
+            h = (h ^ static_cast<uint32_t>(tuple[i])) * 0x9e3779b97f4a7c15ULL;
+            h ^= h >> 29;
+        }
+        return h;
+    }
+
+    // The block is picked using the upper half of the hash. The bits within
+    // the block come from a second hash (the hash remixed with the finalizer
+    // of MurmurHash3), so they don't depend on the bits that picked the block.
+    static uint64_t block_hash(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void insert(uint64_t h)
+    {
+        auto& block = m_blocks[(h >> 32) % m_blocks.size()];
+        const auto bits = block_hash(h);
+        for (size_t i = 0; i < HASH_COUNT; ++i)
+        {
+            const auto bit = (bits >> (i * 9)) & 511;
+            block[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+
+    bool may_contain(uint64_t h) const
+    {
+        const auto& block = m_blocks[(h >> 32) % m_blocks.size()];
+        const auto bits = block_hash(h);
+        for (size_t i = 0; i < HASH_COUNT; ++i)
+        {
+            const auto bit = (bits >> (i * 9)) & 511;
+            if (!(block[bit / 64] & (uint64_t(1) << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+    void rebuild(const souffle::Relation& relation)
+    {
+        // NOTE: sized for twice the current amount of tuples, so facts can be
+        // added afterwards without the false positive rate going up too much.
+        m_count = relation.size();
+        m_capacity = std::max<size_t>(2 * m_count, 64);
+        const auto block_count = (m_capacity * BITS_PER_TUPLE + 511) / 512;
+        m_blocks.assign(block_count, block_t{});
+
+        for (auto& tuple: relation)
+        {
+            insert(hash(tuple));
+        }
+        m_valid = true;
+    }
+
+    // Keeps the filter up to date after a tuple was pushed. The filter is
+    // marked as stale once it holds more tuples than it was sized for.
+    // NOTE: tuples that were already part of the relation are counted too,
+    // this only makes the filter get rebuilt a bit sooner.
+    void inserted(uint64_t h)
+    {
+        if (!m_valid) return;
+        insert(h);
+        if (++m_count > m_capacity) m_valid = false;
+    }
+
+    bool is_up_to_date() const
+    {
+        return m_valid;
+    }
+
+    void invalidate()
+    {
+        m_valid = false;
+    }
+};
+
+// A read-only snapshot of a relation that no longer changes. The tuples are
+// stored contiguously (in the same order as the original relation) for fast
+// scans, and optionally a second copy is stored in Eytzinger order for fast
+// lookups.
+struct frozen_relation : public souffle::Relation
+{
+private:
+    using value_t = souffle::RamDomain;
+
+    // NB: internal iterator, does not satisfy the `iterator` concept.
+    class iterator_frozen : public iterator_base
+    {
+        const frozen_relation *m_frozen;
+        size_t m_index;
+        souffle::tuple m_tuple;
+
+    public:
+        iterator_frozen(const frozen_relation *frozen, size_t index)
+            : iterator_base(reinterpret_cast<std::size_t>(frozen))
+            , m_frozen(frozen)
+            , m_index(index)
+            , m_tuple(frozen)
+        {}
+
+        void operator++() override
+        {
+            ++m_index;
+        }
+
+        souffle::tuple& operator*() override
+        {
+            const auto arity = m_frozen->m_arity;
+            const auto row = m_frozen->row(m_index);
+            m_tuple.rewind();
+            for (size_t i = 0; i < arity; ++i)
+            {
+                m_tuple[i] = row[i];
+            }
+            return m_tuple;
+        }
+
+        iterator_base *clone() const override
+        {
+            return new iterator_frozen(m_frozen, m_index);
+        }
+
+        size_t read(value_t *out, size_t max_tuples)
+        {
+            const auto count = std::min(max_tuples, m_frozen->m_size - m_index);
+            std::copy_n(m_frozen->row(m_index), count * m_frozen->m_arity, out);
+            m_index += count;
+            return count;
+        }
+
+    protected:
+        bool equal(const iterator_base& o) const override
+        {
+            return m_index == static_cast<const iterator_frozen&>(o).m_index;
+        }
+    };
+
+    const souffle::Relation& m_relation;
+    const size_t m_arity;
+    size_t m_size = 0;
+    std::vector<value_t> m_tuples;
+    // 1-based Eytzinger layout, sorted by the raw tuple values. Only built
+    // when lookups are needed (see build_search).
+    std::vector<value_t> m_search;
+    bool m_partial = false;
+
+    const value_t *row(size_t index) const
+    {
+        return m_tuples.data() + index * m_arity;
+    }
+
+    bool less(const value_t *a, const value_t *b) const
+    {
+        return std::lexicographical_compare(a, a + m_arity, b, b + m_arity);
+    }
+
+    size_t fill_search(const std::vector<const value_t*>& sorted, size_t i, size_t k)
+    {
+        if (k > m_size) return i;
+
+        i = fill_search(sorted, i, 2 * k);
+        std::copy(sorted[i], sorted[i] + m_arity, m_search.data() + k * m_arity);
+        return fill_search(sorted, i + 1, 2 * k + 1);
+    }
+
+public:
+    frozen_relation(const souffle::Relation& relation)
+        : m_relation(relation)
+        , m_arity(relation.getArity())
+    {
+        m_size = relation.size();
+        m_tuples.resize(m_size * m_arity);
+        auto cursor = relation.begin();
+        relation.readBatch(cursor, m_tuples.data(), m_size);
+    }
+
+    bool has_search() const
+    {
+        return !m_search.empty();
+    }
+
+    // Builds the search layout, used by contains.
+    void build_search()
+    {
+        assert(!m_partial && "Partial snapshots do not support lookups");
+        if (has_search()) return;
+
+        std::vector<const value_t*> sorted;
+        sorted.reserve(m_size);
+        for (size_t i = 0; i < m_size; ++i)
+        {
+            sorted.push_back(row(i));
+        }
+        std::sort(sorted.begin(), sorted.end(), [this](auto a, auto b) { return less(a, b); });
+
+        m_search.resize((m_size + 1) * m_arity);
+        fill_search(sorted, 0, 1);
+    }
+
+    // Creates a snapshot containing only the given rows of another snapshot,
+    // used for returning part of a relation. This has no search layout.
+    frozen_relation(const frozen_relation& source, const std::vector<size_t>& rows)
+        : m_relation(source.m_relation)
+        , m_arity(source.m_arity)
+        , m_size(rows.size())
+        , m_partial(true)
+    {
+        m_tuples.reserve(rows.size() * m_arity);
+        for (const auto index: rows)
+        {
+            const auto r = source.row(index);
+            m_tuples.insert(m_tuples.end(), r, r + m_arity);
+        }
+    }
+
+    // Same as above, but for a relation that is not frozen. The rows need to
+    // be sorted, the relation is scanned once and only the given rows are
+    // copied.
+    frozen_relation(const souffle::Relation& source, const std::vector<size_t>& rows)
+        : m_relation(source)
+        , m_arity(source.getArity())
+        , m_size(rows.size())
+        , m_partial(true)
+    {
+        m_tuples.reserve(rows.size() * m_arity);
+        auto next = rows.begin();
+        size_t index = 0;
+        for (auto it = source.begin(); next != rows.end() && it != source.end(); ++it, ++index)
+        {
+            if (index != *next) continue;
+
+            auto& tuple = *it;
+            for (size_t i = 0; i < m_arity; ++i)
+            {
+                m_tuples.push_back(tuple[i]);
+            }
+            ++next;
+        }
+    }
+
+    const value_t *data() const
+    {
+        return m_tuples.data();
+    }
+
+    iterator begin() const override
+    {
+        return iterator(std::make_unique<iterator_frozen>(this, 0));
+    }
+
+    iterator end() const override
+    {
+        return iterator(std::make_unique<iterator_frozen>(this, m_size));
+    }
+
+    size_t readBatch(iterator& cursor, value_t *out, size_t max_tuples) const override
+    {
+        return static_cast<iterator_frozen&>(getIteratorBase(cursor)).read(out, max_tuples);
+    }
+
+    void insert(const souffle::tuple&) override
+    {
+        assert(false && "Frozen relations are read-only");
+    }
+
+    bool contains(const souffle::tuple& tuple) const override
+    {
+        if (m_arity == 0) return m_size != 0;
+        assert(!m_partial && "Partial snapshots do not support lookups");
+        // NOTE: the snapshot only exists while the relation is unchanged.
+        if (!has_search()) return m_relation.contains(tuple);
+
+        std::vector<value_t> key(m_arity);
+        for (size_t i = 0; i < m_arity; ++i)
+        {
+            key[i] = tuple[i];
+        }
+
+        // Branchless descent, followed by undoing the trailing right turns.
+        size_t k = 1;
+        while (k <= m_size)
+        {
+            k = 2 * k + less(m_search.data() + k * m_arity, key.data());
+        }
+        k >>= __builtin_ffsll(~k);
+
+        return k != 0 && std::equal(key.begin(), key.end(), m_search.data() + k * m_arity);
+    }
+
+    std::size_t size() const override
+    {
+        return m_size;
+    }
+
+    std::string getName() const override
+    {
+        return m_relation.getName();
+    }
+
+    const char *getAttrType(std::size_t arg) const override
+    {
+        return m_relation.getAttrType(arg);
+    }
+
+    const char *getAttrName(std::size_t arg) const override
+    {
+        return m_relation.getAttrName(arg);
+    }
+
+    arity_type getArity() const override
+    {
+        return m_relation.getArity();
+    }
+
+    arity_type getAuxiliaryArity() const override
+    {
+        return m_relation.getAuxiliaryArity();
+    }
+
+    souffle::SymbolTable& getSymbolTable() const override
+    {
+        return m_relation.getSymbolTable();
+    }
+
+    void purge() override
+    {
+        assert(false && "Frozen relations are read-only");
+    }
+};
+
+// State that is kept for each relation that is accessed from Haskell.
+struct relation
+{
+    using deserializer_t = void(*)(souffle::tuple&, char*, uint32_t&);
+    using serializer_t = void(*)(souffle::tuple&, char*, uint32_t&);
+
+    souffle::Relation *m_relation;
+    // The codec of the relation, looked up once instead of on every call.
+    // There are only serializers for relations without symbols, relations
+    // with symbols are serialized by helpers::Serializer.
+    std::vector<char> m_types;
+    std::vector<deserializer_t> m_deserializers;
+    std::vector<serializer_t> m_serializers;
+    bool m_has_strings;
+    bool m_use_bloom_filter = false;
+    bloom_filter m_bloom_filter;
+    // Guards the Bloom filter, since facts can be pushed on the worker thread
+    // of a pipeline while lookups happen on the calling thread.
+    std::mutex m_bloom_mutex;
+    std::unique_ptr<frozen_relation> m_frozen;
+
+    relation(souffle::Relation *rel,
+             std::vector<char> types,
+             std::vector<deserializer_t> deserializers,
+             std::vector<serializer_t> serializers)
+        : m_relation(rel)
+        , m_types(std::move(types))
+        , m_deserializers(std::move(deserializers))
+        , m_serializers(std::move(serializers))
+        , m_has_strings(std::find(m_types.begin(), m_types.end(), 's') != m_types.end())
+    {
+        assert(rel);
+    }
+
+    void thaw()
+    {
+        // NOTE: only written if there is a snapshot, a pipeline thaws the
+        // relation up front so its worker thread doesn't write here.
+        if (m_frozen) m_frozen.reset();
+    }
+
+    // Creates the snapshot if there is none yet, only done when the relation
+    // is frozen explicitly (see souffle_relation_freeze).
+    const frozen_relation& freeze()
+    {
+        if (!m_frozen) m_frozen = std::make_unique<frozen_relation>(*m_relation);
+        m_frozen->build_search();
+        return *m_frozen;
+    }
+
+    // Returns the frozen snapshot if there is one. Otherwise a flat copy of
+    // the relation is created in "temporary", so one-off reads don't keep a
+    // second copy of the relation alive after they are done.
+    const frozen_relation& frozen_view(std::optional<frozen_relation>& temporary) const
+    {
+        if (m_frozen) return *m_frozen;
+        return temporary.emplace(*m_relation);
+    }
+};
+
+// Returns the frozen snapshot of a relation if there is one, so reads use
+// the read-optimized layout.
+inline souffle::Relation *to_relation(relation_t *rel)
+{
+    if (!rel) return nullptr;
+    return rel->m_frozen
+        ? static_cast<souffle::Relation*>(rel->m_frozen.get())
+        : rel->m_relation;
+}
+
 struct souffle_interface
 {
     std::unique_ptr<souffle::SouffleProgram> m_prog;
     buf_data m_buf;
+    // Keeps track of which symbols (indexed by symbol id) were already sent
+    // to Haskell, used by souffle_tuple_pop_many_cached.
+    std::vector<bool> m_sent_symbols;
+    std::unordered_map<std::string, std::unique_ptr<relation_t>> m_relations;
 
     souffle_interface(souffle::SouffleProgram *prog)
         : m_prog(prog)
@@ -65,6 +511,113 @@ struct souffle_interface
 
         return m_buf.data();
     }
+
+    // Called after Souffle (possibly) changed the contents of relations.
+    void relations_changed()
+    {
+        for (auto& entry: m_relations)
+        {
+            if (!entry.second) continue;
+            entry.second->m_bloom_filter.invalidate();
+            entry.second->thaw();
+        }
+    }
+};
+
+// A copy of the facts of a relation, which is not affected by later changes
+// to the relation (e.g. running the program again). Used for computing the
+// difference between two runs of a program.
+struct relation_snapshot
+{
+    frozen_relation m_frozen;
+    std::vector<char> m_types;
+
+    relation_snapshot(const souffle::Relation& relation, std::vector<char> types)
+        : m_frozen(relation)
+        , m_types(std::move(types))
+    {}
+};
+
+// Inserts chunks of serialized facts into a relation on a worker thread, so
+// Haskell can marshal the next chunk while the previous one is inserted.
+struct pipeline
+{
+private:
+    struct chunk
+    {
+        byte_buf_t *m_buf;
+        size_t m_size;
+    };
+
+    relation_t *m_relation;
+    std::mutex m_mutex;
+    std::condition_variable m_submitted;
+    std::condition_variable m_done;
+    std::deque<chunk> m_queue;
+    std::atomic<size_t> m_completed{0};
+    bool m_finished = false;
+    std::thread m_worker;
+
+    void run()
+    {
+        while (true)
+        {
+            chunk next;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_submitted.wait(lock, [this] { return m_finished || !m_queue.empty(); });
+                if (m_queue.empty()) return;
+                next = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            souffle_tuple_push_many(m_relation, next.m_buf, next.m_size);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_completed.fetch_add(1, std::memory_order_release);
+            }
+            m_done.notify_all();
+        }
+    }
+
+public:
+    pipeline(relation_t *rel)
+        : m_relation(rel)
+        , m_worker([this] { run(); })
+    {
+        assert(rel);
+    }
+
+    ~pipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished = true;
+        }
+        m_submitted.notify_one();
+        m_worker.join();
+    }
+
+    void push(byte_buf_t *buf, size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back({buf, size});
+        }
+        m_submitted.notify_one();
+    }
+
+    size_t completed() const
+    {
+        return m_completed.load(std::memory_order_acquire);
+    }
+
+    void wait(size_t count)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this, count] { return completed() >= count; });
+    }
 };
 
 }
@@ -88,12 +641,6 @@ inline auto parse_signature(const souffle::Relation& relation)
     return types;
 }
 
-inline bool relation_contains_strings(const souffle::Relation& relation)
-{
-    const auto types = parse_signature(relation);
-    return std::any_of(types.begin(), types.end(), [](auto x) { return x == 's'; });
-}
-
 using offset_t = uint32_t;
 
 using number_t = int32_t;
@@ -157,7 +704,7 @@ inline std::string unknown_souffle_type(souffle_type ty)
     return base_message + std::string(1, ty);
 }
 
-inline auto types_to_deserializer(const std::vector<souffle_type>& types)
+inline auto types_to_deserializers(const std::vector<souffle_type>& types)
 {
     std::vector<deserializer_t> deserializers;
     deserializers.reserve(types.size());
@@ -169,16 +716,42 @@ inline auto types_to_deserializer(const std::vector<souffle_type>& types)
         deserializers.push_back(match->second);
     }
 
-    return [deserializers = std::move(deserializers)](souffle::tuple& tuple, char* buf, offset_t& offset)
+    return deserializers;
+}
+
+inline void deserialize_tuple(const std::vector<deserializer_t>& deserializers,
+                              souffle::tuple& tuple, char* buf, offset_t& offset)
+{
+    for (const auto& deserializer : deserializers)
+    {
+        deserializer(tuple, buf + offset, offset);
+    }
+}
+
+// Checks if all symbols in a serialized tuple are already known by Souffle.
+// If one of them is not, the tuple can't be part of any relation.
+inline bool symbols_are_known(const std::vector<souffle_type>& types,
+                              const souffle::SymbolTable& symbol_table,
+                              const char* buf)
+{
+    offset_t offset = 0;
+    for (const auto& type: types)
     {
-        for (const auto& deserializer : deserializers)
+        if (type != 's')
         {
-            deserializer(tuple, buf + offset, offset);
+            offset += sizeof(uint32_t);
+            continue;
         }
-    };
+
+        const auto num_bytes = *reinterpret_cast<const uint32_t*>(buf + offset);
+        const std::string str(buf + offset + sizeof(uint32_t), num_bytes);
+        if (!symbol_table.weakContains(str)) return false;
+        offset += sizeof(uint32_t) + num_bytes;
+    }
+    return true;
 }
 
-inline auto types_to_serializer(const std::vector<souffle_type>& types)
+inline auto types_to_serializers(const std::vector<souffle_type>& types)
 {
     std::vector<serializer_t> serializers;
     serializers.reserve(types.size());
@@ -190,13 +763,16 @@ inline auto types_to_serializer(const std::vector<souffle_type>& types)
         serializers.push_back(match->second);
     }
 
-    return [serializers = std::move(serializers)](souffle::tuple& tuple, char* buf, offset_t& offset)
+    return serializers;
+}
+
+inline void serialize_tuple(const std::vector<serializer_t>& serializers,
+                            souffle::tuple& tuple, char* buf, offset_t& offset)
+{
+    for (const auto& serializer : serializers)
     {
-        for (const auto& serializer : serializers)
-        {
-            serializer(tuple, buf + offset, offset);
-        }
-    };
+        serializer(tuple, buf + offset, offset);
+    }
 }
 
 inline auto guess_tuple_size(const std::vector<souffle_type>& types)
@@ -216,9 +792,10 @@ inline auto guess_tuple_size(const std::vector<souffle_type>& types)
 struct Serializer
 {
 public:
-    inline Serializer(souffle_t *prog, const souffle::Relation& relation)
+    inline Serializer(souffle_t *prog, const souffle::Relation& relation,
+                      const std::vector<souffle_type>& types)
         : m_relation(relation)
-        , m_types(parse_signature(relation))
+        , m_types(types)
         , m_buf(prog->m_buf)
     {
         auto tuple_size = guess_tuple_size(m_types);
@@ -364,24 +941,24 @@ public:
 
 private:
     const souffle::Relation& m_relation;
-    std::vector<souffle_type> m_types;
+    const std::vector<souffle_type>& m_types;
     size_t m_fact_count;
     buf_data& m_buf;
     size_t m_num_bytes;
     offset_t m_offset;
 };
 
-inline byte_buf_t *serialize_slow(souffle_t *prog, const souffle::Relation& relation)
+inline byte_buf_t *serialize_slow(souffle_t *prog, const souffle::Relation& relation,
+                                  const std::vector<souffle_type>& types)
 {
-    Serializer s(prog, relation);
+    Serializer s(prog, relation, types);
     return s.serialize().to_buf();
 }
 
-inline byte_buf_t *serialize_fast(souffle_t *prog, const souffle::Relation& relation)
+inline byte_buf_t *serialize_fast(souffle_t *prog, const souffle::Relation& relation,
+                                  const std::vector<souffle_type>& types,
+                                  const std::vector<serializer_t>& serializers)
 {
-    const auto types = parse_signature(relation);
-    const auto serialize = types_to_serializer(types);
-
     const auto fact_count = relation.size();
     const auto tuple_size = guess_tuple_size(types);
     const auto num_bytes = sizeof(uint32_t) + fact_count * tuple_size;
@@ -394,14 +971,393 @@ inline byte_buf_t *serialize_fast(souffle_t *prog, const souffle::Relation& rela
     *ptr = fact_count;
     offset += 4;
 
-    for (auto& tuple: relation)
+    if constexpr (sizeof(souffle::RamDomain) == sizeof(number_t))
     {
-        serialize(tuple, buf, offset);
+        // NOTE: numbers are sent as-is, so the tuples can be copied straight
+        // into the buffer, without going through souffle::tuple one by one.
+        auto cursor = relation.begin();
+        relation.readBatch(cursor, reinterpret_cast<souffle::RamDomain*>(buf + offset), fact_count);
+    }
+    else
+    {
+        for (auto& tuple: relation)
+        {
+            serialize_tuple(serializers, tuple, buf, offset);
+        }
     }
 
     return reinterpret_cast<byte_buf_t*>(start_ptr);
 }
 
+// Tag for symbols that are sent without using the symbol cache. Symbol ids
+// are sent shifted left by one bit, so only ids below MAX_CACHED_SYMBOL_ID
+// fit in a tag (the largest one would collide with this tag).
+constexpr uint32_t UNCACHED_SYMBOL_TAG = std::numeric_limits<uint32_t>::max();
+constexpr uint64_t MAX_CACHED_SYMBOL_ID = UNCACHED_SYMBOL_TAG >> 1;
+
+inline byte_buf_t *serialize_cached(souffle_t *prog, const souffle::Relation& relation,
+                                    const std::vector<souffle_type>& types)
+{
+    const auto arity = types.size();
+    const auto& symbol_table = relation.getSymbolTable();
+    auto& sent_symbols = prog->m_sent_symbols;
+    auto& buf = prog->m_buf;
+
+    // NOTE: every value needs atleast 4 bytes, only new symbols need more.
+    const auto fact_count = relation.size();
+    const auto num_bytes = sizeof(uint32_t) + fact_count * arity * sizeof(uint32_t);
+    if (num_bytes > buf.size()) buf.resize(num_bytes);
+
+    offset_t offset = 0;
+    const auto reserve = [&](size_t byte_count)
+    {
+        if (offset + byte_count <= buf.size()) return;
+
+        size_t new_num_bytes = buf.size() * GROW_FACTOR;
+        while (offset + byte_count > new_num_bytes) {
+            new_num_bytes *= GROW_FACTOR;
+        }
+
+        buf_data new_buf(new_num_bytes);
+        memcpy(new_buf.data(), buf.data(), offset);
+        std::swap(buf, new_buf);
+    };
+    const auto write_u32 = [&](uint32_t value)
+    {
+        memcpy(buf.data() + offset, &value, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    };
+    const auto write_symbol = [&](souffle::RamDomain value)
+    {
+        const auto& str = symbol_table.decode(value);
+        const uint32_t str_num_bytes = str.length();
+        reserve(sizeof(uint32_t) + str_num_bytes);
+        write_u32(str_num_bytes);
+        std::copy(str.begin(), str.end(), buf.data() + offset);
+        offset += str_num_bytes;
+    };
+
+    write_u32(fact_count);
+
+    for (auto& tuple: relation)
+    {
+        for (size_t i = 0; i < arity; ++i)
+        {
+            const auto value = tuple[i];
+            reserve(sizeof(uint32_t));
+
+            if (types[i] != 's')
+            {
+                write_u32(souffle::ramBitCast<uint32_t>(value));
+                continue;
+            }
+
+            if (value < 0 || static_cast<uint64_t>(value) >= MAX_CACHED_SYMBOL_ID)
+            {
+                write_u32(UNCACHED_SYMBOL_TAG);
+                write_symbol(value);
+                continue;
+            }
+
+            const auto symbol_id = static_cast<uint32_t>(value);
+            if (symbol_id >= sent_symbols.size())
+            {
+                sent_symbols.resize(std::max<size_t>(symbol_id + 1, sent_symbols.size() * 2));
+            }
+
+            if (sent_symbols[symbol_id])
+            {
+                write_u32(symbol_id << 1);
+                continue;
+            }
+
+            sent_symbols[symbol_id] = true;
+            write_u32((symbol_id << 1) | 1);
+            write_symbol(value);
+        }
+    }
+
+    return reinterpret_cast<byte_buf_t*>(buf.data());
+}
+
+// Computes where each chunk of facts starts in a buffer produced by
+// serialize_slow or serialize_fast. Every chunk contains the same amount of
+// facts (rounded up), except for the last one.
+inline void chunk_offsets(const std::vector<souffle_type>& types, const char *buf,
+                          size_t chunk_count, uint32_t *offsets)
+{
+    const auto fact_count = *reinterpret_cast<const uint32_t*>(buf);
+    const size_t chunk_size = (fact_count + chunk_count - 1) / chunk_count;
+    const auto has_strings = std::find(types.begin(), types.end(), 's') != types.end();
+
+    offset_t offset = sizeof(uint32_t);
+    size_t chunk = 0;
+    for (size_t i = 0; i < fact_count; ++i)
+    {
+        if (i % chunk_size == 0)
+        {
+            offsets[chunk++] = offset;
+            // NOTE: without symbols, all facts have the same size.
+            if (!has_strings)
+            {
+                const auto tuple_size = types.size() * sizeof(uint32_t);
+                for (; chunk < chunk_count; ++chunk)
+                {
+                    const auto first = std::min<size_t>(chunk * chunk_size, fact_count);
+                    offsets[chunk] = offset + first * tuple_size;
+                }
+                return;
+            }
+        }
+
+        for (const auto type: types)
+        {
+            const auto num_bytes = type == 's'
+                ? *reinterpret_cast<const uint32_t*>(buf + offset)
+                : 0;
+            offset += sizeof(uint32_t) + num_bytes;
+        }
+    }
+
+    for (; chunk < chunk_count; ++chunk)
+    {
+        offsets[chunk] = offset;
+    }
+}
+
+// The rows of two relations that are only part of one of them.
+struct relation_diff
+{
+    std::vector<size_t> m_removed;  // rows of the first relation
+    std::vector<size_t> m_added;    // rows of the second relation
+};
+
+// Returns the rows of a snapshot, sorted by the given keys. Snapshots are
+// usually sorted already, in which case this is a linear check.
+inline std::vector<size_t> sorted_rows(const souffle::RamDomain *keys, size_t arity,
+                                       std::vector<size_t> rows)
+{
+    const auto less = [keys, arity](size_t x, size_t y)
+    {
+        const auto a = keys + x * arity;
+        const auto b = keys + y * arity;
+        return std::lexicographical_compare(a, a + arity, b, b + arity);
+    };
+    if (!std::is_sorted(rows.begin(), rows.end(), less))
+    {
+        std::sort(rows.begin(), rows.end(), less);
+    }
+    return rows;
+}
+
+// Computes the difference between two snapshots of relations with the same
+// signature, by merging the sorted tuples of both. If the relations belong
+// to different programs, symbols of the second relation are first translated
+// to the symbol ids of the first program.
+inline relation_diff diff_relations(const frozen_relation& a, const frozen_relation& b,
+                                    const std::vector<souffle_type>& types)
+{
+    using value_t = souffle::RamDomain;
+    const auto arity = types.size();
+    auto& a_symbols = a.getSymbolTable();
+    const auto& b_symbols = b.getSymbolTable();
+    const auto has_strings = std::find(types.begin(), types.end(), 's') != types.end();
+
+    relation_diff diff;
+    std::vector<size_t> a_rows(a.size());
+    std::iota(a_rows.begin(), a_rows.end(), 0);
+    std::vector<size_t> b_rows;
+    b_rows.reserve(b.size());
+
+    const value_t *b_keys = b.data();
+    std::vector<value_t> translated;
+    if (has_strings && &a_symbols != &b_symbols)
+    {
+        translated.assign(b.data(), b.data() + b.size() * arity);
+        for (size_t row = 0; row < b.size(); ++row)
+        {
+            auto key = translated.data() + row * arity;
+            bool known = true;
+            for (size_t i = 0; i < arity && known; ++i)
+            {
+                if (types[i] != 's') continue;
+
+                const auto& str = b_symbols.decode(key[i]);
+                known = a_symbols.weakContains(str);
+                if (known) key[i] = a_symbols.encode(str);
+            }
+            // NOTE: a symbol that the first program doesn't know can't be
+            // part of any of its tuples.
+            if (known) b_rows.push_back(row);
+            else diff.m_added.push_back(row);
+        }
+        b_keys = translated.data();
+    }
+    else
+    {
+        b_rows.resize(b.size());
+        std::iota(b_rows.begin(), b_rows.end(), 0);
+    }
+
+    a_rows = sorted_rows(a.data(), arity, std::move(a_rows));
+    b_rows = sorted_rows(b_keys, arity, std::move(b_rows));
+
+    const auto a_key = [&](size_t index) { return a.data() + a_rows[index] * arity; };
+    const auto b_key = [&](size_t index) { return b_keys + b_rows[index] * arity; };
+    const auto compare = [arity](const value_t *x, const value_t *y)
+    {
+        const auto mismatch = std::mismatch(x, x + arity, y);
+        if (mismatch.first == x + arity) return 0;
+        return *mismatch.first < *mismatch.second ? -1 : 1;
+    };
+    // First index in b_rows that is not smaller than the given key.
+    const auto b_lower_bound = [&](const value_t *key)
+    {
+        size_t lo = 0, hi = b_rows.size();
+        while (lo < hi)
+        {
+            const auto mid = lo + (hi - lo) / 2;
+            if (compare(b_key(mid), key) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    };
+
+    // The merge is split into chunks of the first relation. Each chunk is
+    // matched with the part of the second relation in the same key range,
+    // so the chunks can be merged independently on multiple threads.
+    const size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunk_count = std::max<size_t>(1, std::min(max_threads, a_rows.size() / DIFF_CHUNK_SIZE));
+    std::vector<size_t> a_bounds(chunk_count + 1), b_bounds(chunk_count + 1);
+    for (size_t chunk = 0; chunk <= chunk_count; ++chunk)
+    {
+        a_bounds[chunk] = a_rows.size() * chunk / chunk_count;
+    }
+    b_bounds[0] = 0;
+    b_bounds[chunk_count] = b_rows.size();
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk)
+    {
+        b_bounds[chunk] = b_lower_bound(a_key(a_bounds[chunk]));
+    }
+
+    std::vector<relation_diff> chunk_diffs(chunk_count);
+    const auto merge = [&](size_t chunk)
+    {
+        auto& result = chunk_diffs[chunk];
+        auto i = a_bounds[chunk], j = b_bounds[chunk];
+        const auto i_end = a_bounds[chunk + 1], j_end = b_bounds[chunk + 1];
+        while (i < i_end && j < j_end)
+        {
+            const auto order = compare(a_key(i), b_key(j));
+            if (order < 0) result.m_removed.push_back(a_rows[i++]);
+            else if (order > 0) result.m_added.push_back(b_rows[j++]);
+            else { ++i; ++j; }
+        }
+        for (; i < i_end; ++i) result.m_removed.push_back(a_rows[i]);
+        for (; j < j_end; ++j) result.m_added.push_back(b_rows[j]);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk)
+    {
+        threads.emplace_back(merge, chunk);
+    }
+    merge(0);
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+
+    for (const auto& result: chunk_diffs)
+    {
+        diff.m_removed.insert(diff.m_removed.end(), result.m_removed.begin(), result.m_removed.end());
+        diff.m_added.insert(diff.m_added.end(), result.m_added.begin(), result.m_added.end());
+    }
+    return diff;
+}
+
+// Serializes the given rows of a snapshot, the same way as serialize_slow.
+// Returns the offset right after the serialized facts.
+inline offset_t serialize_rows(const frozen_relation& relation, const std::vector<souffle_type>& types,
+                               const std::vector<size_t>& rows, char *buf, offset_t offset)
+{
+    const auto arity = types.size();
+    const auto& symbol_table = relation.getSymbolTable();
+    const auto write_u32 = [&](uint32_t value)
+    {
+        memcpy(buf + offset, &value, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+    };
+
+    write_u32(rows.size());
+    for (const auto index: rows)
+    {
+        const auto row = relation.data() + index * arity;
+        for (size_t i = 0; i < arity; ++i)
+        {
+            switch (types[i])
+            {
+                case 's':
+                {
+                    const auto& str = symbol_table.decode(row[i]);
+                    write_u32(str.length());
+                    std::copy(str.begin(), str.end(), buf + offset);
+                    offset += str.length();
+                    break;
+                }
+                case 'u':
+                    write_u32(static_cast<unsigned_t>(souffle::ramBitCast<souffle::RamUnsigned>(row[i])));
+                    break;
+                case 'f':
+                {
+                    const auto value = static_cast<float_t>(souffle::ramBitCast<souffle::RamFloat>(row[i]));
+                    memcpy(buf + offset, &value, sizeof(float_t));
+                    offset += sizeof(float_t);
+                    break;
+                }
+                default:
+                    write_u32(static_cast<uint32_t>(static_cast<number_t>(souffle::ramBitCast<souffle::RamSigned>(row[i]))));
+                    break;
+            }
+        }
+    }
+    return offset;
+}
+
+// Returns the amount of bytes serialize_rows needs for the given rows.
+inline size_t serialized_rows_size(const frozen_relation& relation, const std::vector<souffle_type>& types,
+                                   const std::vector<size_t>& rows)
+{
+    const auto arity = types.size();
+    size_t num_bytes = sizeof(uint32_t) + rows.size() * arity * sizeof(uint32_t);
+    if (std::find(types.begin(), types.end(), 's') == types.end()) return num_bytes;
+
+    const auto& symbol_table = relation.getSymbolTable();
+    for (const auto index: rows)
+    {
+        const auto row = relation.data() + index * arity;
+        for (size_t i = 0; i < arity; ++i)
+        {
+            if (types[i] == 's') num_bytes += symbol_table.decode(row[i]).length();
+        }
+    }
+    return num_bytes;
+}
+
+// Computes the difference between two snapshots and serializes it: first the
+// facts only in the first snapshot, then the facts only in the second one.
+inline byte_buf_t *serialize_diff(souffle_t *prog, const frozen_relation& a,
+                                  const frozen_relation& b, const std::vector<souffle_type>& types)
+{
+    const auto diff = diff_relations(a, b, types);
+    const auto num_bytes = serialized_rows_size(a, types, diff.m_removed)
+                         + serialized_rows_size(b, types, diff.m_added);
+    auto buf = prog->get_buf(num_bytes);
+    const auto offset = serialize_rows(a, types, diff.m_removed, buf, 0);
+    serialize_rows(b, types, diff.m_added, buf, offset);
+    return reinterpret_cast<byte_buf_t*>(buf);
+}
+
 }  // namespace helpers
 
 extern "C"
@@ -434,6 +1390,7 @@ extern "C"
     {
         assert(program);
         program->m_prog->run();
+        program->relations_changed();
     }
 
     void souffle_load_all(souffle_t *program, const char *input_directory)
@@ -441,6 +1398,7 @@ extern "C"
         assert(program);
         assert(input_directory);
         program->m_prog->loadAll(input_directory);
+        program->relations_changed();
     }
 
     void souffle_print_all(souffle_t *program, const char *output_directory)
@@ -454,56 +1412,306 @@ extern "C"
     {
         assert(program);
         assert(relation_name);
+        auto it = program->m_relations.find(relation_name);
+        if (it != program->m_relations.end()) return it->second.get();
+
         auto relation = program->m_prog->getRelation(relation_name);
-        assert(relation);
-        return reinterpret_cast<relation_t *>(relation);
+        if (!relation) return nullptr;
+        auto types = helpers::parse_signature(*relation);
+        auto deserializers = helpers::types_to_deserializers(types);
+        auto serializers = std::find(types.begin(), types.end(), 's') == types.end()
+            ? helpers::types_to_serializers(types)
+            : std::vector<helpers::serializer_t>{};
+        auto& rel = program->m_relations[relation_name];
+        rel = std::make_unique<relation_t>(relation, std::move(types),
+                                           std::move(deserializers), std::move(serializers));
+        return rel.get();
     }
 
     bool souffle_contains_tuple(relation_t *rel, byte_buf_t *buf)
     {
-        auto relation = reinterpret_cast<souffle::Relation *>(rel);
+        auto relation = to_relation(rel);
         auto data = reinterpret_cast<char*>(buf);
         assert(relation && "Relation is NULL in souffle_contains_tuple");
         assert(data && "byte buf is NULL in souffle_contains_tuple");
 
         auto& r = *relation;
-        const auto types = helpers::parse_signature(r);
-        const auto deserialize_tuple = helpers::types_to_deserializer(types);
+        if (!rel->m_use_bloom_filter)
+        {
+            souffle::tuple tuple(relation);
+            helpers::offset_t offset = 0;
+            helpers::deserialize_tuple(rel->m_deserializers, tuple, data, offset);
+            return r.contains(tuple);
+        }
+
+        // NOTE: checking the symbols first avoids adding unknown symbols to
+        // the symbol table, which would be a waste for a relation that is
+        // mostly queried for facts it doesn't contain.
+        if (rel->m_has_strings
+            && !helpers::symbols_are_known(rel->m_types, r.getSymbolTable(), data))
+        {
+            return false;
+        }
 
         souffle::tuple tuple(relation);
         helpers::offset_t offset = 0;
-        deserialize_tuple(tuple, data, offset);
-        return r.contains(tuple);
+        helpers::deserialize_tuple(rel->m_deserializers, tuple, data, offset);
+
+        std::lock_guard<std::mutex> lock(rel->m_bloom_mutex);
+        auto& bloom_filter = rel->m_bloom_filter;
+        if (!bloom_filter.is_up_to_date())
+        {
+            bloom_filter.rebuild(r);
+        }
+        return bloom_filter.may_contain(bloom_filter::hash(tuple))
+            && r.contains(tuple);
     }
 
     void souffle_tuple_push_many(relation_t *rel, byte_buf_t *buf, size_t size)
     {
-        auto relation = reinterpret_cast<souffle::Relation*>(rel);
+        if (rel) rel->thaw();
+        auto relation = to_relation(rel);
         auto data = reinterpret_cast<char*>(buf);
         assert(data && "byte buf is NULL in souffle_tuple_push_many");
         assert(relation && "Relation is NULL in souffle_tuple_push_many");
 
         auto& r = *relation;
-        const auto types = helpers::parse_signature(r);
-        const auto deserialize_tuple = helpers::types_to_deserializer(types);
+
+        // NOTE: this can run on the worker thread of a pipeline, so the lock
+        // is held for the entire batch instead of being taken per fact.
+        std::unique_lock<std::mutex> lock(rel->m_bloom_mutex, std::defer_lock);
+        if (rel->m_use_bloom_filter) lock.lock();
 
         helpers::offset_t offset = 0;
         for (size_t i = 0; i < size; ++i)
         {
             souffle::tuple tuple(relation);
-            deserialize_tuple(tuple, data, offset);
+            helpers::deserialize_tuple(rel->m_deserializers, tuple, data, offset);
             r.insert(tuple);
+
+            if (rel->m_use_bloom_filter)
+            {
+                rel->m_bloom_filter.inserted(bloom_filter::hash(tuple));
+            }
         }
     }
 
+    void souffle_relation_freeze(relation_t *rel)
+    {
+        assert(rel && "Relation is NULL in souffle_relation_freeze");
+        rel->freeze();
+    }
+
+    void souffle_relation_use_bloom_filter(relation_t *rel, bool enable)
+    {
+        assert(rel && "Relation is NULL in souffle_relation_use_bloom_filter");
+        std::lock_guard<std::mutex> lock(rel->m_bloom_mutex);
+        rel->m_use_bloom_filter = enable;
+        rel->m_bloom_filter.invalidate();
+    }
+
     byte_buf_t *souffle_tuple_pop_many(souffle_t *prog, relation_t *rel)
     {
-        auto relation = reinterpret_cast<souffle::Relation*>(rel);
+        auto relation = to_relation(rel);
         assert(prog && "Program is NULL in souffle_tuple_pop_many");
         assert(relation && "Relation is NULL in souffle_tuple_pop_many");
         auto& r = *relation;
-        return helpers::relation_contains_strings(r)
-            ? helpers::serialize_slow(prog, r)
-            : helpers::serialize_fast(prog, r);
+        return rel->m_has_strings
+            ? helpers::serialize_slow(prog, r, rel->m_types)
+            : helpers::serialize_fast(prog, r, rel->m_types, rel->m_serializers);
+    }
+
+    byte_buf_t *souffle_tuple_pop_range(souffle_t *prog, relation_t *rel,
+                                        size_t offset, size_t limit)
+    {
+        assert(prog && "Program is NULL in souffle_tuple_pop_range");
+        assert(rel && "Relation is NULL in souffle_tuple_pop_range");
+
+        const auto size = to_relation(rel)->size();
+        const auto first = std::min(offset, size);
+        const auto last = first + std::min(limit, size - first);
+        std::vector<size_t> rows(last - first);
+        std::iota(rows.begin(), rows.end(), first);
+
+        // NOTE: a frozen snapshot gives constant time access to the n-th
+        // fact, otherwise the relation is scanned up to the last requested
+        // fact. Only the requested facts are copied.
+        const auto selection = rel->m_frozen
+            ? frozen_relation(*rel->m_frozen, rows)
+            : frozen_relation(*rel->m_relation, rows);
+        return rel->m_has_strings
+            ? helpers::serialize_slow(prog, selection, rel->m_types)
+            : helpers::serialize_fast(prog, selection, rel->m_types, rel->m_serializers);
+    }
+
+    byte_buf_t *souffle_tuple_sample(souffle_t *prog, relation_t *rel,
+                                     size_t count, uint64_t seed)
+    {
+        assert(prog && "Program is NULL in souffle_tuple_sample");
+        assert(rel && "Relation is NULL in souffle_tuple_sample");
+
+        const auto size = to_relation(rel)->size();
+        std::vector<size_t> rows;
+        if (count >= size)
+        {
+            rows.resize(size);
+            std::iota(rows.begin(), rows.end(), 0);
+        }
+        else
+        {
+            // Floyd's algorithm: picks "count" distinct rows uniformly.
+            std::mt19937_64 rng(seed);
+            std::unordered_set<size_t> picked;
+            picked.reserve(count);
+            for (size_t j = size - count; j < size; ++j)
+            {
+                const auto index = std::uniform_int_distribution<size_t>(0, j)(rng);
+                picked.insert(picked.count(index) ? j : index);
+            }
+            rows.assign(picked.begin(), picked.end());
+            std::sort(rows.begin(), rows.end());
+        }
+
+        const auto selection = rel->m_frozen
+            ? frozen_relation(*rel->m_frozen, rows)
+            : frozen_relation(*rel->m_relation, rows);
+        return rel->m_has_strings
+            ? helpers::serialize_slow(prog, selection, rel->m_types)
+            : helpers::serialize_fast(prog, selection, rel->m_types, rel->m_serializers);
+    }
+
+    byte_buf_t *souffle_tuple_pop_chunked(souffle_t *prog, relation_t *rel,
+                                          size_t chunk_count, uint32_t *offsets)
+    {
+        assert(prog && "Program is NULL in souffle_tuple_pop_chunked");
+        assert(rel && "Relation is NULL in souffle_tuple_pop_chunked");
+        assert(chunk_count > 0 && "Chunk count is 0 in souffle_tuple_pop_chunked");
+        assert(offsets && "Offsets are NULL in souffle_tuple_pop_chunked");
+
+        auto buf = souffle_tuple_pop_many(prog, rel);
+        helpers::chunk_offsets(rel->m_types, reinterpret_cast<const char*>(buf),
+                               chunk_count, offsets);
+        return buf;
+    }
+
+    byte_buf_t *souffle_relation_diff(souffle_t *prog, relation_t *rel_a, relation_t *rel_b)
+    {
+        assert(prog && "Program is NULL in souffle_relation_diff");
+        assert(rel_a && "Relation is NULL in souffle_relation_diff");
+        assert(rel_b && "Relation is NULL in souffle_relation_diff");
+        assert(rel_a->m_types == rel_b->m_types && "Relations have different signatures");
+
+        // NOTE: the diff only needs the flat arrays, not the search layout.
+        std::optional<frozen_relation> temporary_a, temporary_b;
+        const auto& a = rel_a->frozen_view(temporary_a);
+        const auto& b = rel_b->frozen_view(temporary_b);
+        return helpers::serialize_diff(prog, a, b, rel_a->m_types);
+    }
+
+    snapshot_t *souffle_relation_snapshot(relation_t *rel)
+    {
+        assert(rel && "Relation is NULL in souffle_relation_snapshot");
+        return new relation_snapshot(*to_relation(rel), rel->m_types);
+    }
+
+    void souffle_snapshot_free(snapshot_t *snapshot)
+    {
+        delete snapshot;
+    }
+
+    byte_buf_t *souffle_snapshot_diff(souffle_t *prog, snapshot_t *snapshot, relation_t *rel)
+    {
+        assert(prog && "Program is NULL in souffle_snapshot_diff");
+        assert(snapshot && "Snapshot is NULL in souffle_snapshot_diff");
+        assert(rel && "Relation is NULL in souffle_snapshot_diff");
+        assert(snapshot->m_types == rel->m_types && "Relations have different signatures");
+
+        std::optional<frozen_relation> temporary;
+        const auto& b = rel->frozen_view(temporary);
+        return helpers::serialize_diff(prog, snapshot->m_frozen, b, rel->m_types);
+    }
+
+    pipeline_t *souffle_pipeline_start(relation_t *rel)
+    {
+        assert(rel && "Relation is NULL in souffle_pipeline_start");
+        // NOTE: frozen snapshots are dropped here, instead of on the worker.
+        rel->thaw();
+        return new pipeline(rel);
+    }
+
+    void souffle_pipeline_push(pipeline_t *pipeline, byte_buf_t *buf, size_t size)
+    {
+        assert(pipeline && "Pipeline is NULL in souffle_pipeline_push");
+        assert(buf && "byte buf is NULL in souffle_pipeline_push");
+        pipeline->push(buf, size);
+    }
+
+    size_t souffle_pipeline_completed(pipeline_t *pipeline)
+    {
+        assert(pipeline && "Pipeline is NULL in souffle_pipeline_completed");
+        return pipeline->completed();
+    }
+
+    void souffle_pipeline_wait(pipeline_t *pipeline, size_t count)
+    {
+        assert(pipeline && "Pipeline is NULL in souffle_pipeline_wait");
+        pipeline->wait(count);
+    }
+
+    void souffle_pipeline_finish(pipeline_t *pipeline)
+    {
+        assert(pipeline && "Pipeline is NULL in souffle_pipeline_finish");
+        delete pipeline;
+    }
+
+    byte_buf_t *souffle_tuple_pop_many_cached(souffle_t *prog, relation_t *rel)
+    {
+        auto relation = to_relation(rel);
+        assert(prog && "Program is NULL in souffle_tuple_pop_many_cached");
+        assert(relation && "Relation is NULL in souffle_tuple_pop_many_cached");
+        auto& r = *relation;
+        return rel->m_has_strings
+            ? helpers::serialize_cached(prog, r, rel->m_types)
+            : helpers::serialize_fast(prog, r, rel->m_types, rel->m_serializers);
+    }
+
+    void souffle_clear_symbol_cache(souffle_t *prog)
+    {
+        assert(prog && "Program is NULL in souffle_clear_symbol_cache");
+        prog->m_sent_symbols.clear();
+    }
+
+    size_t souffle_relation_size(relation_t *rel)
+    {
+        auto relation = to_relation(rel);
+        assert(relation && "Relation is NULL in souffle_relation_size");
+        return relation->size();
+    }
+
+    size_t souffle_tuple_pop_into(relation_t *rel, byte_buf_t *buf, size_t max_count)
+    {
+        auto relation = to_relation(rel);
+        auto data = reinterpret_cast<souffle::RamDomain*>(buf);
+        assert(relation && "Relation is NULL in souffle_tuple_pop_into");
+        assert(data && "byte buf is NULL in souffle_tuple_pop_into");
+        assert(!rel->m_has_strings
+               && "Relation contains symbols in souffle_tuple_pop_into");
+
+        // NOTE: floats and unsigned values are stored bitcasted inside a
+        // RamDomain, so the raw values are already in the expected format.
+        auto cursor = relation->begin();
+        return relation->readBatch(cursor, data, max_count);
+    }
+
+    size_t souffle_relation_layout(relation_t *rel, char *types, size_t capacity)
+    {
+        auto relation = to_relation(rel);
+        assert(relation && "Relation is NULL in souffle_relation_layout");
+        assert((types || capacity == 0) && "types is NULL in souffle_relation_layout");
+
+        const auto& signature = rel->m_types;
+        const auto count = std::min(capacity, signature.size());
+        std::copy(signature.begin(), signature.begin() + count, types);
+        return signature.size();
     }
 }
@@ -15,6 +15,10 @@ extern "C"
     typedef struct relation relation_t;
     // Opaque struct representing a byte array filled with data.
     typedef struct byte_buf byte_buf_t;
+    // Opaque struct representing a pipeline for inserting facts.
+    typedef struct pipeline pipeline_t;
+    // Opaque struct representing a snapshot of the facts of a relation.
+    typedef struct relation_snapshot snapshot_t;
 
     /*
      * Initializes a Souffle program. The name of the program should be the
@@ -86,6 +90,9 @@ extern "C"
      * You need to check if the passed pointers are non-NULL before passing it
      * to this function. Not doing so results in undefined behavior.
      *
+     * Tuples containing symbols that are unknown to the program are rejected
+     * without looking them up in the relation.
+     *
      * Returns true if the tuple was found in the relation; otherwise false.
      */
     bool souffle_contains_tuple(relation_t *relation, byte_buf_t *buf);
@@ -99,6 +106,53 @@ extern "C"
      */
     void souffle_tuple_push_many(relation_t *relation, byte_buf_t *buf, size_t size);
 
+    /*
+     * Starts a pipeline for adding facts to a relation. Facts that are pushed
+     * to the pipeline are inserted on a separate worker thread, so the next
+     * batch of facts can be serialized in the meantime.
+     * No other operations on the program should be performed until the
+     * pipeline is finished (see souffle_pipeline_finish).
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns a pipeline, that needs to be freed with souffle_pipeline_finish.
+     */
+    pipeline_t *souffle_pipeline_start(relation_t *relation);
+
+    /*
+     * Queues a buffer of "size" serialized facts for insertion (in the same
+     * format as souffle_tuple_push_many). This function returns immediately,
+     * the buffer needs to stay valid until the facts are inserted (see
+     * souffle_pipeline_completed and souffle_pipeline_wait).
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    void souffle_pipeline_push(pipeline_t *pipeline, byte_buf_t *buf, size_t size);
+
+    /*
+     * Returns how many of the buffers pushed to the pipeline were inserted
+     * already. This function does not block.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    size_t souffle_pipeline_completed(pipeline_t *pipeline);
+
+    /*
+     * Blocks until at least "count" of the buffers pushed to the pipeline
+     * were inserted.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    void souffle_pipeline_wait(pipeline_t *pipeline, size_t count);
+
+    /*
+     * Waits until all buffers pushed to the pipeline are inserted, and frees
+     * the pipeline afterwards.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    void souffle_pipeline_finish(pipeline_t *pipeline);
+
     /**
      * Pops many Datalog facts from Datalog to Haskell.
      * You need to check if the passed pointers are non-NULL before passing it
@@ -109,6 +163,195 @@ extern "C"
      * need to be cleaned up.
      */
     byte_buf_t *souffle_tuple_pop_many(souffle_t *program, relation_t *relation);
+
+    /**
+     * Pops many Datalog facts from Datalog to Haskell, using a per-program
+     * symbol cache. Instead of serializing each symbol as a string, a symbol
+     * is serialized as a 4 byte tag containing "(id << 1) | is_new". Only the
+     * first time a symbol is sent to Haskell (for this program), "is_new" is
+     * set and the tag is followed by the serialized string. Afterwards only
+     * the tag is sent, the Haskell side is expected to remember the string
+     * for a given symbol id. Symbols with an id that doesn't fit in the tag
+     * are not cached: they are sent as the tag 0xFFFFFFFF, followed by the
+     * serialized string. All other values are serialized as in
+     * souffle_tuple_pop_many.
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the byte buffer that contains the serialized Datalog facts.
+     * This byte buffer is automatically managed by the C++ side and does not
+     * need to be cleaned up.
+     */
+    byte_buf_t *souffle_tuple_pop_many_cached(souffle_t *program, relation_t *relation);
+
+    /**
+     * Forgets which symbols were already sent by souffle_tuple_pop_many_cached,
+     * so all of them are sent again (including their strings) afterwards.
+     * This is used when the Haskell side could not store all received symbols.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    void souffle_clear_symbol_cache(souffle_t *program);
+
+    /**
+     * Pops part of the Datalog facts of a relation, starting at the fact with
+     * index "offset" and containing at most "limit" facts. The facts are
+     * serialized the same way as in souffle_tuple_pop_many.
+     * Only the requested facts are copied. If the relation is frozen (see
+     * souffle_relation_freeze), only the requested facts are visited,
+     * otherwise the relation is scanned up to the last requested fact.
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the byte buffer that contains the serialized Datalog facts.
+     * This byte buffer is automatically managed by the C++ side and does not
+     * need to be cleaned up.
+     */
+    byte_buf_t *souffle_tuple_pop_range(souffle_t *program, relation_t *relation,
+                                        size_t offset, size_t limit);
+
+    /**
+     * Pops a uniform random sample of "count" distinct Datalog facts of a
+     * relation (or all facts, if the relation contains less facts). The same
+     * seed returns the same sample, as long as the relation did not change.
+     * The facts are serialized the same way as in souffle_tuple_pop_many.
+     * Only the sampled facts are copied, the relation is scanned once if it
+     * isn't frozen (see souffle_relation_freeze).
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the byte buffer that contains the serialized Datalog facts.
+     * This byte buffer is automatically managed by the C++ side and does not
+     * need to be cleaned up.
+     */
+    byte_buf_t *souffle_tuple_sample(souffle_t *program, relation_t *relation,
+                                     size_t count, uint64_t seed);
+
+    /**
+     * Pops all Datalog facts of a relation, like souffle_tuple_pop_many, and
+     * splits them into "chunk_count" chunks that can be deserialized
+     * independently. Every chunk contains the same amount of facts (rounded
+     * up), except for the last one. The byte offset (relative to the start of
+     * the buffer) where each chunk starts is written to "offsets", which needs
+     * room for "chunk_count" values. Chunks that contain no facts start at the
+     * end of the buffer.
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the byte buffer that contains the serialized Datalog facts.
+     * This byte buffer is automatically managed by the C++ side and does not
+     * need to be cleaned up.
+     */
+    byte_buf_t *souffle_tuple_pop_chunked(souffle_t *program, relation_t *relation,
+                                          size_t chunk_count, uint32_t *offsets);
+
+    /**
+     * Computes the difference between two relations with the same signature.
+     * The relations can belong to different programs, symbols are compared by
+     * their string value in that case. Relations that aren't frozen (see
+     * souffle_relation_freeze) are copied for the duration of this call.
+     * The byte buffer contains the facts that are only part of the first
+     * relation ("removed"), followed by the facts that are only part of the
+     * second relation ("added"). Both are serialized the same way as in
+     * souffle_tuple_pop_many.
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the byte buffer that contains the serialized Datalog facts.
+     * This byte buffer is automatically managed by the C++ side and does not
+     * need to be cleaned up.
+     */
+    byte_buf_t *souffle_relation_diff(souffle_t *program, relation_t *relation_a,
+                                      relation_t *relation_b);
+
+    /**
+     * Creates a snapshot of all facts currently in a relation. The snapshot is
+     * not affected by later changes to the relation, for example by running
+     * the program again. It can be used together with souffle_snapshot_diff
+     * to compare two runs of the same program.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns a pointer to the snapshot, which needs to be freed with
+     * souffle_snapshot_free. The snapshot can only be used as long as the
+     * program it was created from is not freed.
+     */
+    snapshot_t *souffle_relation_snapshot(relation_t *relation);
+
+    /**
+     * Frees a snapshot created by souffle_relation_snapshot.
+     */
+    void souffle_snapshot_free(snapshot_t *snapshot);
+
+    /**
+     * Computes the difference between a snapshot and a relation with the
+     * same signature, like souffle_relation_diff. The snapshot is treated as
+     * the first relation, so "removed" facts are only part of the snapshot
+     * and "added" facts are only part of the relation.
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the byte buffer that contains the serialized Datalog facts.
+     * This byte buffer is automatically managed by the C++ side and does not
+     * need to be cleaned up.
+     */
+    byte_buf_t *souffle_snapshot_diff(souffle_t *program, snapshot_t *snapshot,
+                                      relation_t *relation);
+
+    /*
+     * Returns the number of facts that are currently stored in a relation.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    size_t souffle_relation_size(relation_t *relation);
+
+    /**
+     * Copies Datalog facts directly into a byte buffer owned by the caller.
+     * The facts are written as a packed array of 4-byte values, without a
+     * leading fact count. This only works for relations that contain no
+     * symbols, and the buffer needs to be large enough to hold "max_count"
+     * facts.
+     * You need to check if the passed pointers are non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the number of facts that were written into the buffer.
+     */
+    size_t souffle_tuple_pop_into(relation_t *relation, byte_buf_t *buf, size_t max_count);
+
+    /*
+     * Describes the layout of the facts of a relation. One character is
+     * written into "types" for each field of the relation ('i' for numbers,
+     * 'u' for unsigned numbers, 'f' for floats and 's' for symbols), up to
+     * "capacity" characters. "types" is allowed to be NULL if "capacity" is 0.
+     * All non-symbol fields are serialized as 4-byte values, so the offset of a
+     * field in a fact without symbols is 4 times its index.
+     * You need to check if the passed relation pointer is non-NULL before
+     * passing it to this function. Not doing so results in undefined behavior.
+     *
+     * Returns the arity of the relation.
+     */
+    size_t souffle_relation_layout(relation_t *relation, char *types, size_t capacity);
+
+    /*
+     * Enables or disables a Bloom filter for a relation, used by
+     * souffle_contains_tuple to quickly reject facts that are not part of the
+     * relation. The filter is built lazily on the next lookup and is rebuilt
+     * after running the program or loading facts from disk.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    void souffle_relation_use_bloom_filter(relation_t *relation, bool enable);
+
+    /*
+     * Freezes a relation: a read-only snapshot of the relation is created,
+     * which stores all facts in a compact array (with a cache-friendly search
+     * layout). All following pops and lookups of the relation use this
+     * snapshot. The snapshot is discarded as soon as facts are pushed to the
+     * relation, or when the program is run or loads facts from disk.
+     * You need to check if the passed pointer is non-NULL before passing it
+     * to this function. Not doing so results in undefined behavior.
+     */
+    void souffle_relation_freeze(relation_t *relation);
 #ifdef __cplusplus
 }
 #endif
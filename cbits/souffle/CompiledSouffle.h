@@ -23,6 +23,7 @@
 #include "souffle/SymbolTable.h"
 #include "souffle/datastructure/BTreeDelete.h"
 #include "souffle/datastructure/Brie.h"
+#include "souffle/datastructure/ConcurrentFlyweight.h"
 #include "souffle/datastructure/EquivalenceRelation.h"
 #include "souffle/datastructure/RecordTableImpl.h"
 #include "souffle/datastructure/SymbolTableImpl.h"
@@ -30,6 +31,8 @@
 #include "souffle/io/IOSystem.h"
 #include "souffle/io/WriteStream.h"
 #include "souffle/utility/EvaluatorUtil.h"
+#include <cstring>
+#include <type_traits>
 #ifndef __EMBEDDED_SOUFFLE__
 #include "souffle/CompiledOptions.h"
 #endif
@@ -46,6 +49,21 @@ inline souffle::SouffleProgram* getInstance(const char* p) {
 }
 }
 
+namespace detail {
+
+/**
+ * Checks whether an index iterator can expose runs of tuples that are stored
+ * contiguously (see btree::iterator::run), so they can be copied at once.
+ */
+template <typename Iter, typename = void>
+struct has_contiguous_runs : std::false_type {};
+
+template <typename Iter>
+struct has_contiguous_runs<Iter, std::void_t<decltype(std::declval<const Iter&>().run())>>
+        : std::true_type {};
+
+}  // namespace detail
+
 /**
  * Relation wrapper used internally in the generated Datalog program
  */
@@ -87,6 +105,26 @@ private:
         iterator_base* clone() const override {
             return new iterator_wrapper(*this);
         }
+        std::size_t read(RamDomain* out, std::size_t maxTuples, const typename RelType::iterator& last) {
+            std::size_t count = 0;
+            if constexpr (detail::has_contiguous_runs<typename RelType::iterator>::value &&
+                          sizeof(*it) == sizeof(TupleType)) {
+                // NB: the tuples are stored in declared column order, so leaves are copied as-is.
+                while (count < maxTuples && it != last) {
+                    const std::size_t n = std::min<std::size_t>(it.run(), maxTuples - count);
+                    std::memcpy(out + count * Arity, &*it, n * sizeof(TupleType));
+                    it.advance(n);
+                    count += n;
+                }
+                return count;
+            }
+            for (; count < maxTuples && it != last; ++it, ++count) {
+                auto&& value = *it;
+                for (std::size_t i = 0; i < Arity; i++)
+                    out[count * Arity + i] = value[i];
+            }
+            return count;
+        }
 
     protected:
         bool equal(const iterator_base& o) const override {
@@ -107,6 +145,10 @@ public:
     iterator end() const override {
         return iterator(mk<iterator_wrapper>(id, this, relation.end()));
     }
+    std::size_t readBatch(iterator& cursor, RamDomain* out, std::size_t maxTuples) const override {
+        auto& wrapper = asAssert<iterator_wrapper>(getIteratorBase(cursor));
+        return wrapper.read(out, maxTuples, relation.end());
+    }
 
     void insert(const tuple& arg) override {
         TupleType t;
@@ -325,6 +367,141 @@ private:
     Lock insert_lock;
 };
 
+/**
+ * Hash relations, for relations that are only queried with all attributes
+ * bound (e.g. exact lookups). Range queries are not supported.
+ */
+template <Relation::arity_type Arity_>
+class t_hash {
+public:
+    static constexpr Relation::arity_type Arity = Arity_;
+    using t_tuple = Tuple<RamDomain, Arity>;
+
+private:
+    struct t_hasher {
+        std::size_t operator()(const t_tuple& t) const {
+            std::size_t seed = 0;
+            for (std::size_t i = 0; i < Arity; ++i) {
+                const auto value = static_cast<std::size_t>(ramBitCast<RamUnsigned>(t[i]));
+                seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+            }
+            return seed;
+        }
+    };
+
+    struct t_ind : public FlyweightImpl<t_tuple, t_hasher> {
+        using Base = FlyweightImpl<t_tuple, t_hasher>;
+        explicit t_ind(const std::size_t LaneCount) : Base(LaneCount) {}
+        void setNumLanes(const std::size_t NumLanes) {
+            Base::setNumLanes(NumLanes);
+        }
+    };
+
+    std::size_t lanes;
+    Own<t_ind> ind;
+    std::atomic<std::size_t> count{0};
+#ifdef _SOUFFLE_STATS
+    mutable LockStatistics lock_stats;
+    LockStatistics& lockStats() const {
+        return lock_stats;
+    }
+#else
+    static LockStatistics& lockStats() {
+        return LockStatistics::global();
+    }
+#endif
+
+public:
+    t_hash(const std::size_t LaneCount = MAX_THREADS) : lanes(LaneCount), ind(mk<t_ind>(LaneCount)) {}
+
+    struct context {};
+    context createContext() {
+        return context();
+    }
+    class iterator {
+        typename t_ind::iterator it;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = t_tuple;
+        using difference_type = ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        iterator(const typename t_ind::iterator& o) : it(o) {}
+
+        const t_tuple& operator*() const {
+            return it->first;
+        }
+
+        const t_tuple* operator->() const {
+            return &it->first;
+        }
+
+        bool operator==(const iterator& other) const {
+            return other.it == it;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+
+        iterator& operator++() {
+            ++it;
+            return *this;
+        }
+    };
+    iterator begin() const {
+        return iterator(ind->begin());
+    }
+    iterator end() const {
+        return iterator(ind->end());
+    }
+    bool insert(const t_tuple& t) {
+        LockStatistics::Site lock_site(lockStats());
+        if (ind->findOrInsert(t).second) {
+            ++count;
+            return true;
+        }
+        return false;
+    }
+    bool insert(const t_tuple& t, context& /* ctxt */) {
+        return insert(t);
+    }
+    bool insert(const RamDomain* ramDomain) {
+        t_tuple t;
+        std::copy(ramDomain, ramDomain + Arity, t.begin());
+        return insert(t);
+    }
+    bool contains(const t_tuple& t) const {
+        return ind->weakContains(t);
+    }
+    bool contains(const t_tuple& t, context& /* ctxt */) const {
+        return contains(t);
+    }
+    std::size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    std::vector<range<iterator>> partition() const {
+        return {make_range(begin(), end())};
+    }
+    void setNumLanes(const std::size_t NumLanes) {
+        lanes = NumLanes;
+        ind->setNumLanes(NumLanes);
+    }
+    void purge() {
+        ind = mk<t_ind>(lanes);
+        count = 0;
+    }
+    void printStatistics(std::ostream& o) const {
+        o << "  Elements: " << size() << "\n";
+        lockStats().print(o);
+    }
+};
+
 /** Equivalence relations */
 struct t_eqrel {
     static constexpr Relation::arity_type Arity = 2;
@@ -80,8 +80,15 @@ public:
 
     /***
      * set signal handlers
+     *
+     * Multiple programs can run concurrently, each calling set() and reset().
+     * The handlers are only installed by the first and restored by the last.
      */
     void set() {
+        std::lock_guard<std::mutex> guard(setMutex);
+        if (activeCount++ > 0) {
+            return;
+        }
         if (!isSet && std::getenv("SOUFFLE_ALLOW_SIGNALS") == nullptr) {
             // register signals
             // floating point exception
@@ -107,6 +114,10 @@ public:
      * reset signal handlers
      */
     void reset() {
+        std::lock_guard<std::mutex> guard(setMutex);
+        if (activeCount == 0 || --activeCount > 0) {
+            return;
+        }
         if (isSet) {
             // reset floating point exception
             if (signal(SIGFPE, prevFpeHandler) == SIG_ERR) {
@@ -148,6 +159,10 @@ private:
     // state of signal handler
     bool isSet = false;
 
+    // number of running programs that called set(), protected by setMutex
+    std::size_t activeCount = 0;
+    std::mutex setMutex;
+
     bool logMessages = false;
 
     // previous signal handler routines
@@ -21,6 +21,7 @@
 #include "souffle/SymbolTable.h"
 #include "souffle/utility/MiscUtil.h"
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -154,6 +155,8 @@ public:
      * Users must use iterator class to access the tuples stored in a relation.
      */
     class iterator {
+        friend class Relation;
+
     protected:
         /*
          * iterator_base class pointer.
@@ -283,6 +286,17 @@ public:
         }
     };
 
+protected:
+    /**
+     * Get the iterator_base an iterator is wrapping.
+     * Child classes use this to continue from a cursor in readBatch.
+     *
+     * @param it Reference to an iterator object
+     * @return Reference to the iterator_base object of it
+     */
+    static iterator_base& getIteratorBase(const iterator& it);
+
+public:
     /**
      * Insert a new tuple into the relation.
      * The definition of insert function has to be defined by the child class of relation class.
@@ -315,6 +329,22 @@ public:
      */
     virtual iterator end() const = 0;
 
+    /**
+     * Read a batch of tuples, starting at the tuple the cursor is pointing to.
+     *
+     * At most maxTuples tuples are copied into out, one after the other, with
+     * getArity() values per tuple. Afterwards, the cursor points to the first
+     * tuple that was not read yet, so it can be passed to the next call.
+     * The default implementation walks the tuples one by one; child classes
+     * should override this to copy tuples directly from their own storage.
+     *
+     * @param cursor Iterator obtained from begin(), or from a previous call
+     * @param out Buffer with room for maxTuples * getArity() values
+     * @param maxTuples The maximum number of tuples to read (std::size_t)
+     * @return The number of tuples that were read (std::size_t)
+     */
+    virtual std::size_t readBatch(iterator& cursor, RamDomain* out, std::size_t maxTuples) const;
+
     /**
      * Get the number of tuples in a relation.
      *
@@ -440,15 +470,36 @@ public:
  * as a tuple, (1, 2, 3) will be stored.
  */
 class tuple {
+    /**
+     * Tuples with at most this many elements store them inline, so that creating or copying them does not
+     * allocate. Wider tuples store their elements on the heap.
+     */
+    static constexpr std::size_t InlineArity = 8;
+
     /**
      * The relation to which the tuple belongs.
      */
     const Relation& relation;
 
     /**
-     * Dynamic array used to store the elements in a tuple.
+     * The number of elements in the tuple.
+     */
+    Relation::arity_type arity;
+
+    /**
+     * Inline storage for the elements of small tuples.
      */
-    std::vector<RamDomain> array;
+    std::array<RamDomain, InlineArity> inlineArray{};
+
+    /**
+     * Heap storage for the elements of wide tuples, unused for small tuples.
+     */
+    std::unique_ptr<RamDomain[]> heapArray;
+
+    /**
+     * Array used to store the elements in a tuple, points to either inlineArray or heapArray.
+     */
+    RamDomain* array;
 
     /**
      * pos shows what the current position of a tuple is.
@@ -461,6 +512,20 @@ class tuple {
      */
     std::size_t pos;
 
+    /**
+     * Select the storage for the elements of the tuple, based on its arity.
+     * The elements are initialized to zero.
+     *
+     * @return Pointer to the first element of the tuple
+     */
+    RamDomain* allocate() {
+        if (arity <= InlineArity) {
+            return inlineArray.data();
+        }
+        heapArray = std::make_unique<RamDomain[]>(arity);
+        return heapArray.get();
+    }
+
 public:
     /**
      * Constructor.
@@ -476,7 +541,7 @@ public:
      *
      * @param r Relation pointer pointing to a relation
      */
-    tuple(const Relation* r) : relation(*r), array(r->getArity()), pos(0), data(array.data()) {}
+    tuple(const Relation* r) : relation(*r), arity(r->getArity()), array(allocate()), pos(0), data(array) {}
 
     /**
      * Constructor.
@@ -489,7 +554,10 @@ public:
      *
      * @param Reference to a tuple object.
      */
-    tuple(const tuple& t) : relation(t.relation), array(t.array), pos(t.pos), data(array.data()) {}
+    tuple(const tuple& t)
+            : relation(t.relation), arity(t.arity), array(allocate()), pos(t.pos), data(array) {
+        std::copy_n(t.array, arity, array);
+    }
 
     /**
      * Allows printing using WriteStream.
@@ -511,8 +579,7 @@ public:
      * @return the number of elements in the tuple (std::size_t).
      */
     Relation::arity_type size() const {
-        assert(array.size() <= std::numeric_limits<Relation::arity_type>::max());
-        return Relation::arity_type(array.size());
+        return arity;
     }
 
     /**
@@ -675,19 +742,39 @@ public:
      *
      * @see Relation::iteraor::begin()
      */
-    decltype(array)::iterator begin() {
-        return array.begin();
+    RamDomain* begin() {
+        return array;
     }
 
     /**
      * Construct using initialisation list.
      */
     tuple(const Relation* relation, std::initializer_list<RamDomain> tupleList)
-            : relation(*relation), array(tupleList), pos(tupleList.size()), data(array.data()) {
+            : relation(*relation), arity(tupleList.size()), array(allocate()), pos(tupleList.size()),
+              data(array) {
         assert(tupleList.size() == relation->getArity() && "tuple arity does not match relation arity");
+        std::copy(tupleList.begin(), tupleList.end(), array);
     }
 };
 
+inline Relation::iterator_base& Relation::getIteratorBase(const iterator& it) {
+    assert(it.iter && "invalid iterator");
+    return *it.iter;
+}
+
+inline std::size_t Relation::readBatch(iterator& cursor, RamDomain* out, std::size_t maxTuples) const {
+    const auto arity = getArity();
+    const auto last = end();
+    std::size_t count = 0;
+    for (; count < maxTuples && cursor != last; ++cursor, ++count) {
+        tuple& t = *cursor;
+        for (arity_type i = 0; i < arity; i++) {
+            out[count * arity + i] = t[i];
+        }
+    }
+    return count;
+}
+
 /**
  * Abstract base class for generated Datalog programs.
  */
@@ -908,6 +908,39 @@ public:
         // the index of the element currently addressed within the referenced node
         field_index_type pos = 0;
 
+        friend class btree;
+
+        // the number of leaf nodes that are prefetched ahead of the current one
+        static constexpr size_type prefetchDistance = 4;
+
+        // issues a software prefetch for all cache lines of the given leaf node
+        static void prefetch(node const* leaf) {
+#if defined(__GNUC__)
+            const auto* ptr = reinterpret_cast<const char*>(leaf);
+            for (std::size_t i = 0; i < sizeof(leaf_node); i += 64) {
+                __builtin_prefetch(ptr + i);
+            }
+#else
+            (void)leaf;
+#endif
+        }
+
+        // prefetches the leaf that is a few positions to the right of the current leaf,
+        // so full scans do not stall on a cache miss at every leaf transition
+        void prefetchAhead() const {
+            node const* parent = cur->getParent();
+            if (parent == nullptr) {
+                return;
+            }
+            const size_type position = cur->getPositionInParent();
+            const size_type last = parent->getNumElements();
+            // when entering the first leaf of a parent, none of its siblings were prefetched yet
+            const size_type first = (position == 0) ? 1 : position + prefetchDistance;
+            for (size_type i = first; i <= position + prefetchDistance && i <= last; ++i) {
+                prefetch(parent->getChild(i));
+            }
+        }
+
     public:
         using iterator_category = std::forward_iterator_tag;
         using value_type = Key;
@@ -962,6 +995,7 @@ public:
                     cur = cur->getChildren()[0];
                 }
                 pos = 0;
+                prefetchAhead();
 
                 // nodes may be empty due to biased insertion
                 if (!cur->isEmpty()) {
@@ -980,6 +1014,19 @@ public:
             return *this;
         }
 
+        // the number of elements stored contiguously starting at the current one -- the rest of
+        // the current leaf, or just the current element if it is part of an inner node
+        size_type run() const {
+            return cur->isLeaf() ? cur->getNumElements() - pos : 1;
+        }
+
+        // moves this iterator forward by n elements, where n must not exceed run()
+        iterator& advance(size_type n) {
+            assert(0 < n && n <= run());
+            pos += n - 1;
+            return ++(*this);
+        }
+
         // prints a textual representation of this iterator to the given stream (mainly for debugging)
         void print(std::ostream& out = std::cout) const {
             out << cur << "[" << (int)pos << "]";
@@ -1058,6 +1105,18 @@ protected:
     // the hint statistic of this b-tree instance
     mutable hint_statistics hint_stats;
 
+    // the lock contention statistic of insertions into this b-tree instance
+#ifdef _SOUFFLE_STATS
+    mutable LockStatistics lock_stats;
+    LockStatistics& lockStats() const {
+        return lock_stats;
+    }
+#else
+    static LockStatistics& lockStats() {
+        return LockStatistics::global();
+    }
+#endif
+
 public:
     // the maximum number of keys stored per node
     static constexpr std::size_t max_keys_per_node = node::maxKeys;
@@ -1125,12 +1184,14 @@ public:
      */
     bool insert(const Key& k, operation_hints& hints) {
 #ifdef IS_PARALLEL
+        LockStatistics::Site lock_site(lockStats());
 
         // special handling for inserting first element
         while (root == nullptr) {
             // try obtaining root-lock
             if (!root_lock.try_start_write()) {
                 // somebody else was faster => re-check
+                lockStats().addRetry();
                 continue;
             }
 
@@ -1221,6 +1282,7 @@ public:
                     // validate results
                     if (!cur->lock.validate(cur_lease)) {
                         // start over again
+                        lockStats().addRetry();
                         return insert(k, hints);
                     }
 
@@ -1228,6 +1290,7 @@ public:
                     if (typeid(Comparator) != typeid(WeakComparator) && less(k, *pos)) {
                         if (!cur->lock.try_upgrade_to_write(cur_lease)) {
                             // start again
+                            lockStats().addRetry();
                             return insert(k, hints);
                         }
                         update(*pos, k);
@@ -1248,6 +1311,7 @@ public:
                 // check whether there was a write
                 if (!cur->lock.end_read(cur_lease)) {
                     // start over
+                    lockStats().addRetry();
                     return insert(k, hints);
                 }
 
@@ -1276,6 +1340,7 @@ public:
                 // validate result
                 if (!cur->lock.validate(cur_lease)) {
                     // start over again
+                    lockStats().addRetry();
                     return insert(k, hints);
                 }
 
@@ -1283,6 +1348,7 @@ public:
                 if (typeid(Comparator) != typeid(WeakComparator) && less(k, *(pos - 1))) {
                     if (!cur->lock.try_upgrade_to_write(cur_lease)) {
                         // start again
+                        lockStats().addRetry();
                         return insert(k, hints);
                     }
                     update(*(pos - 1), k);
@@ -1298,6 +1364,7 @@ public:
             if (!cur->lock.try_upgrade_to_write(cur_lease)) {
                 // something has changed => restart
                 hints.last_insert.access(cur);
+                lockStats().addRetry();
                 return insert(k, hints);
             }
 
@@ -1365,6 +1432,7 @@ public:
                     cur->lock.end_write();
 
                     // insert in sibling
+                    lockStats().addRetry();
                     return insert(k, hints);
                 }
             }
@@ -1513,7 +1581,11 @@ public:
 
     // Obtains an iterator referencing the first element of the tree.
     iterator begin() const {
-        return iterator(leftmost, 0);
+        iterator res(leftmost, 0);
+        if (leftmost != nullptr) {
+            res.prefetchAhead();
+        }
+        return res;
     }
 
     // Obtains an iterator referencing the position after the last element of the tree.
@@ -1871,6 +1943,7 @@ public:
             << hint_stats.lower_bound.getMisses() << "/" << hint_stats.lower_bound.getAccesses() << "\n";
         out << "  upper-bound-hint (hits/misses/total):" << hint_stats.upper_bound.getHits() << "/"
             << hint_stats.upper_bound.getMisses() << "/" << hint_stats.upper_bound.getAccesses() << "\n";
+        lockStats().print(out);
         out << " ---------------------------------\n";
     }
 
@@ -133,8 +133,173 @@ constexpr std::size_t hardware_destructive_interference_size = 2 * sizeof(max_al
 #define MAX_THREADS (1)
 #endif
 
+#ifdef _SOUFFLE_STATS
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#endif
+
 namespace souffle {
 
+/**
+ * Counters describing the contention on locks. They are only collected when
+ * compiling with _SOUFFLE_STATS, otherwise all operations are no-ops.
+ *
+ * Locks record their events in the statistics of the current lock site, which
+ * is selected per thread using LockStatistics::Site (e.g. the B-tree of a
+ * relation while inserting into it). Events that happen outside of any site
+ * are recorded in LockStatistics::global().
+ */
+#ifdef _SOUFFLE_STATS
+
+class LockStatistics {
+    std::atomic<std::size_t> failedValidations{0};
+    std::atomic<std::size_t> retries{0};
+    std::atomic<std::size_t> spins{0};
+    std::atomic<std::size_t> blockedWaits{0};
+    std::atomic<std::size_t> blockedNanos{0};
+
+    static LockStatistics*& current() {
+        static thread_local LockStatistics* stats = nullptr;
+        return stats;
+    }
+
+public:
+    /** Selects the statistics that locks record their events in, for the lifetime of the site. */
+    class Site {
+        LockStatistics* previous;
+
+    public:
+        explicit Site(LockStatistics& stats) : previous(current()) {
+            current() = &stats;
+        }
+        Site(const Site&) = delete;
+        Site& operator=(const Site&) = delete;
+        ~Site() {
+            current() = previous;
+        }
+    };
+
+    LockStatistics() = default;
+    LockStatistics(const LockStatistics&) = delete;
+
+    static LockStatistics& global() {
+        static LockStatistics stats;
+        return stats;
+    }
+
+    static LockStatistics& site() {
+        LockStatistics* stats = current();
+        return stats ? *stats : global();
+    }
+
+    /** Locks the given mutex, recording the time spent waiting if it was already locked. */
+    static void lock(std::mutex& mux) {
+        if (mux.try_lock()) {
+            return;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        mux.lock();
+        auto& stats = site();
+        stats.addBlockedWait();
+        stats.addBlockedTime(std::chrono::steady_clock::now() - start);
+    }
+
+    void addFailedValidation() {
+        failedValidations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void addRetry() {
+        retries.fetch_add(1, std::memory_order_relaxed);
+    }
+    void addSpin() {
+        spins.fetch_add(1, std::memory_order_relaxed);
+    }
+    void addBlockedWait() {
+        blockedWaits.fetch_add(1, std::memory_order_relaxed);
+    }
+    void addBlockedTime(const std::chrono::steady_clock::duration duration) {
+        const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        blockedNanos.fetch_add(static_cast<std::size_t>(nanos), std::memory_order_relaxed);
+    }
+    std::size_t getFailedValidations() const {
+        return failedValidations;
+    }
+    std::size_t getRetries() const {
+        return retries;
+    }
+    std::size_t getSpins() const {
+        return spins;
+    }
+    std::size_t getBlockedWaits() const {
+        return blockedWaits;
+    }
+    std::size_t getBlockedNanos() const {
+        return blockedNanos;
+    }
+    void reset() {
+        failedValidations = 0;
+        retries = 0;
+        spins = 0;
+        blockedWaits = 0;
+        blockedNanos = 0;
+    }
+
+    void print(std::ostream& out) const {
+        out << "  lock (failed validations/retries/spins/blocked waits/blocked ms): "
+            << getFailedValidations() << "/" << getRetries() << "/" << getSpins() << "/"
+            << getBlockedWaits() << "/" << (getBlockedNanos() / 1e6) << "\n";
+    }
+};
+
+#else
+
+class LockStatistics {
+public:
+    class Site {
+    public:
+        explicit Site(LockStatistics& /* stats */) {}
+    };
+
+    static LockStatistics& global() {
+        static LockStatistics stats;
+        return stats;
+    }
+    static LockStatistics& site() {
+        return global();
+    }
+    template <typename Mutex>
+    static void lock(Mutex& mux) {
+        mux.lock();
+    }
+
+    inline void addFailedValidation() {}
+    inline void addRetry() {}
+    inline void addSpin() {}
+    inline void addBlockedWait() {}
+    template <typename Duration>
+    inline void addBlockedTime(const Duration& /* duration */) {}
+    inline std::size_t getFailedValidations() const {
+        return 0;
+    }
+    inline std::size_t getRetries() const {
+        return 0;
+    }
+    inline std::size_t getSpins() const {
+        return 0;
+    }
+    inline std::size_t getBlockedWaits() const {
+        return 0;
+    }
+    inline std::size_t getBlockedNanos() const {
+        return 0;
+    }
+    inline void reset() {}
+    template <typename Stream>
+    inline void print(Stream& /* out */) const {}
+};
+
+#endif
+
 struct SeqConcurrentLanes {
     struct TrivialLock {
         ~TrivialLock() {}
@@ -250,14 +415,32 @@ namespace detail {
  */
 class Waiter {
     int i = 0;
+#ifdef _SOUFFLE_STATS
+    std::chrono::steady_clock::time_point start;
+#endif
 
 public:
     Waiter() = default;
+    Waiter(const Waiter&) = delete;
+
+#ifdef _SOUFFLE_STATS
+    ~Waiter() {
+        if (i > 0) {
+            LockStatistics::site().addBlockedTime(std::chrono::steady_clock::now() - start);
+        }
+    }
+#endif
 
     /**
      * Conducts a wait operation.
      */
     void operator()() {
+#ifdef _SOUFFLE_STATS
+        if (i == 0) {
+            start = std::chrono::steady_clock::now();
+        }
+        LockStatistics::site().addSpin();
+#endif
         ++i;
         if ((i % 1000) == 0) {
             // there was no progress => let others work
@@ -444,7 +627,11 @@ public:
     bool validate(const Lease& lease) {
         // check whether version number has changed in the mean-while
         std::atomic_thread_fence(std::memory_order_acquire);
-        return lease.version == version.load(std::memory_order_relaxed);
+        if (lease.version == version.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        LockStatistics::site().addFailedValidation();
+        return false;
     }
 
     /**
@@ -509,6 +696,7 @@ public:
 
         // if there was, undo write update
         abort_write();
+        LockStatistics::site().addFailedValidation();
 
         // operation failed
         return false;
@@ -580,13 +768,14 @@ struct MutexConcurrentLanes {
     }
 
     unique_lock_type guard(const lane_id Lane) const {
-        return unique_lock_type(Lanes[Lane].Access);
+        LockStatistics::lock(Lanes[Lane].Access);
+        return unique_lock_type(Lanes[Lane].Access, std::adopt_lock);
     }
 
     // Lock the given lane.
     // Must eventually be followed by unlock(Lane).
     void lock(const lane_id Lane) const {
-        Lanes[Lane].Access.lock();
+        LockStatistics::lock(Lanes[Lane].Access);
     }
 
     // Unlock the given lane.
@@ -606,7 +795,7 @@ struct MutexConcurrentLanes {
             // So we release our lane lock to let the concurrent operation
             // progress.
             unlock(Lane);
-            BeforeLockAll.lock();
+            LockStatistics::lock(BeforeLockAll);
             lock(Lane);
         }
     }
@@ -627,7 +816,7 @@ struct MutexConcurrentLanes {
     void lockAllBut(const lane_id Lane) const {
         for (std::size_t I = 0; I < Size; ++I) {
             if (I != Lane) {
-                Lanes[I].Access.lock();
+                LockStatistics::lock(Lanes[I].Access);
             }
         }
     }
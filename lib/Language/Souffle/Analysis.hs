@@ -6,6 +6,10 @@
      of how the 'Analysis' type works, see this
      <https://luctielen.com/posts/analyses_are_arrows/ blogpost>.
 
+     Analyses that are combined applicatively (for example using '<*>', '&&&'
+     or '***') do not depend on each other. 'execAnalysisConcurrently' makes
+     use of this by running these independent branches at the same time.
+
      If you are just starting out using this library, you are probably better
      of taking a look at the "Language.Souffle.Interpreted" module instead to
      start interacting with a single Datalog program.
@@ -13,11 +17,15 @@
 module Language.Souffle.Analysis
   ( Analysis
   , mkAnalysis
+  , mkAnalysisWithThreads
   , execAnalysis
+  , execAnalysisConcurrently
   ) where
 
 import Prelude hiding (id, (.))
 import Data.Kind (Type)
+import Data.Foldable (traverse_)
+import Data.Word (Word64)
 import Control.Category
 import Control.Monad
 import Control.Arrow
@@ -34,21 +42,72 @@ import Data.Profunctor
 --   types of the analysis.
 type Analysis :: (Type -> Type) -> Type -> Type -> Type
 data Analysis m a b
-  = Analysis (a -> m ()) (m ()) (a -> m b)
+  = Analysis (a -> m ()) [Step m] (a -> m b)
+
+-- | A single, independent step for running (part of) an 'Analysis'.
+--   The optional function limits the amount of threads used by the step.
+type Step :: (Type -> Type) -> Type
+data Step m = Step (Maybe (Word64 -> m ())) (m ())
 
 -- | Creates an 'Analysis' value.
 mkAnalysis :: (a -> m ()) -- ^ Function for finding facts used by the 'Analysis'.
            -> m ()        -- ^ Function for actually running the 'Analysis'.
            -> m b         -- ^ Function for retrieving the 'Analysis' results from Souffle.
            -> Analysis m a b
-mkAnalysis f r g = Analysis f r (const g)
+mkAnalysis f r g = Analysis f [Step Nothing r] (const g)
 {-# INLINABLE mkAnalysis #-}
 
+-- | Creates an 'Analysis' value, that can be given a share of the total
+--   amount of threads when it is executed with 'execAnalysisConcurrently'.
+--   In most cases, the second argument is @setNumThreads handle@.
+mkAnalysisWithThreads :: (a -> m ())      -- ^ Function for finding facts used by the 'Analysis'.
+                      -> (Word64 -> m ()) -- ^ Function for setting the amount of threads used by the 'Analysis'.
+                      -> m ()             -- ^ Function for actually running the 'Analysis'.
+                      -> m b              -- ^ Function for retrieving the 'Analysis' results from Souffle.
+                      -> Analysis m a b
+mkAnalysisWithThreads f t r g = Analysis f [Step (Just t) r] (const g)
+{-# INLINABLE mkAnalysisWithThreads #-}
+
 -- | Converts an 'Analysis' into an effectful function, so it can be executed.
 execAnalysis :: Applicative m => Analysis m a b -> (a -> m b)
-execAnalysis (Analysis f r g) a = f a *> r *> g a
+execAnalysis (Analysis f rs g) a =
+  f a *> traverse_ (\(Step _ r) -> r) rs *> g a
 {-# INLINABLE execAnalysis #-}
 
+{- | Converts an 'Analysis' into an effectful function, that runs all
+     independent branches of the 'Analysis' at the same time.
+
+     The first argument runs a list of actions concurrently, for example
+     @runConcurrently@ from "Language.Souffle.Compiled". The second argument
+     is the total amount of threads, which is split evenly between the
+     branches created with 'mkAnalysisWithThreads'.
+
+     Branches that run at the same time should use separate program handles,
+     since a handle can only run one program at a time. Analyses that are
+     composed sequentially (using '.' or '>>>') are run as part of collecting
+     the facts for the next analysis, and are not run concurrently.
+-}
+execAnalysisConcurrently :: Applicative m
+                         => ([m ()] -> m ()) -> Word64 -> Analysis m a b -> (a -> m b)
+execAnalysisConcurrently runAll threadCount (Analysis f rs g) a =
+  f a *> runSteps *> g a
+  where
+    runSteps = case rs of
+      [] -> pure ()
+      [step] -> runStep threadCount step
+      _ -> runAll $ zipWith runStep (splitThreads threadCount (length rs)) rs
+    runStep n (Step t r) = traverse_ ($ n) t *> r
+{-# INLINABLE execAnalysisConcurrently #-}
+
+-- | Splits the amount of threads over a number of branches. Each branch gets
+--   at least one thread.
+splitThreads :: Word64 -> Int -> [Word64]
+splitThreads threadCount branchCount =
+  [ max 1 (perBranch + if i < remainder then 1 else 0) | i <- [0 .. count - 1] ]
+  where
+    count = fromIntegral branchCount
+    (perBranch, remainder) = threadCount `quotRem` count
+
 instance Functor m => Functor (Analysis m a) where
   fmap func (Analysis f r g) =
     Analysis f r (fmap func <$> g)
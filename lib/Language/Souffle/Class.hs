@@ -23,6 +23,7 @@ module Language.Souffle.Class
   , ContainsInputFact
   , ContainsOutputFact
   , ContainsFact
+  , FactIndex
   , MonadSouffle(..)
   , MonadSouffleFileIO(..)
   ) where
@@ -87,23 +88,27 @@ type family FormatDirection dir where
 
 -- | A helper type family for checking if a specific Souffle `Program` contains
 --   a certain `Fact`. This constraint will generate a user-friendly type error
---   if this is not the case.
+--   if this is not the case. It also makes the position of the fact in
+--   'ProgramFacts' available (see 'FactIndex').
 type ContainsFact :: Type -> Type -> Constraint
 type family ContainsFact prog fact where
   ContainsFact prog fact =
-    CheckContains prog (ProgramFacts prog) fact
-
-type CheckContains :: Type -> [Type] -> Type -> Constraint
-type family CheckContains prog facts fact :: Constraint where
-  CheckContains prog '[] fact =
+    KnownNat (FactIndex prog (ProgramFacts prog) fact)
+
+-- | A helper type family for looking up the position of a fact in the
+--   list of facts of a program, used by the compiled backend to look up
+--   relations by index instead of by name.
+type FactIndex :: Type -> [Type] -> Type -> Nat
+type family FactIndex prog facts fact where
+  FactIndex prog '[] fact =
     TypeError ('Text "You tried to perform an action with a fact of type '" ':<>: 'ShowType fact
     ':<>: 'Text "' for program '" ':<>: 'ShowType prog ':<>: 'Text "'."
     ':$$: 'Text "The program contains the following facts: " ':<>: 'ShowType (ProgramFacts prog) ':<>: 'Text "."
     ':$$: 'Text "It does not contain fact: " ':<>: 'ShowType fact ':<>: 'Text "."
     ':$$: 'Text "You can fix this error by adding the type '" ':<>: 'ShowType fact
     ':<>: 'Text "' to the ProgramFacts type in the Program instance for " ':<>: 'ShowType prog ':<>: 'Text ".")
-  CheckContains _ (a ': _) a = ()
-  CheckContains prog (_ ': as) b = CheckContains prog as b
+  FactIndex _ (a ': _) a = 0
+  FactIndex prog (_ ': as) b = 1 + FactIndex prog as b
 
 -- | A typeclass for describing a datalog program.
 --
@@ -241,6 +246,12 @@ class Monad m => MonadSouffle m where
   type SubmitFacts m (a :: Type) :: Constraint
 
   -- | Runs the Souffle program.
+  --
+  --   Running a program again after adding more facts keeps the facts that
+  --   were derived by the previous run, but all rules are evaluated again on
+  --   all facts. There is no incremental evaluation of only the consequences
+  --   of newly added facts, since that requires support from the code that
+  --   Souffle generates for the program.
   run :: Handler m prog -> m ()
 
   -- | Sets the number of CPU cores this Souffle program should use.
@@ -23,42 +23,66 @@ module Language.Souffle.Compiled
   , ContainsInputFact
   , ContainsOutputFact
   , Submit
+  , FactNames
+  , StorableFact
+  , FixedFact
   , Handle
   , SouffleM
   , MonadSouffle(..)
   , MonadSouffleFileIO(..)
   , runSouffle
+  , getFactsStorable
+  , getFactsCached
+  , addFactsFixed
+  , getFactsFixed
+  , useBloomFilter
+  , freezeRelation
+  , getFactsRange
+  , getFactsSample
+  , addFactsParallel
+  , getFactsParallel
+  , addFactsPipelined
+  , runConcurrently
+  , getFactsDiff
+  , Snapshot
+  , snapshotFacts
+  , getFactsDiffSince
   ) where
 
 import Prelude hiding ( init )
 import Control.Monad.State.Strict
-import Data.Foldable ( traverse_ )
+import Data.Char ( ord )
+import Data.Foldable ( for_, traverse_, foldl', toList )
 import Data.Functor.Identity
 import Data.Proxy
 import Data.Kind
 import qualified Data.Array as A
 import qualified Data.Array.IO as A
 import qualified Data.Array.Unsafe as A
-import qualified Data.ByteString as BS
 import qualified Data.ByteString.Unsafe as BSU
 import qualified Data.Text as T
-import qualified Data.Text.Encoding as TE
+import qualified Data.Text.Array as TA
+import qualified Data.Text.Internal as TI
 import qualified Data.Text.Internal.StrictBuilder as TB
 import qualified Data.Text.Lazy as TL
 import qualified Data.Vector as V
 import qualified Data.Vector.Mutable as MV
+import qualified Data.Vector.Storable as SV
+import Data.Bits ( (.&.), shiftR )
 import Data.Int
 import Data.Word
 import Foreign.ForeignPtr
-import Foreign.ForeignPtr.Unsafe
-import Foreign (copyBytes)
+import Foreign.Marshal.Array ( allocaArray, peekArray )
 import Foreign.Ptr
 import qualified Foreign.Storable as S
 import GHC.Generics
+import GHC.TypeLits ( TypeError, ErrorMessage(..), natVal )
 import Language.Souffle.Class
 import qualified Language.Souffle.Internal as Internal
+import Language.Souffle.Internal.Concurrent ( concurrently, concurrently_ )
 import Language.Souffle.Marshal
 import Control.Concurrent
+import Control.Exception ( ErrorCall(..), evaluate, finally, onException, throwIO )
 
 
 type ByteCount :: Type
@@ -66,6 +90,11 @@ type ByteCount = Int
 type ByteBuf :: Type
 type ByteBuf = Internal.ByteBuf
 
+-- | Strings of all symbols that were already returned by Souffle,
+--   indexed by symbol id. Only used by 'getFactsCached'.
+type SymbolCache :: Type
+type SymbolCache = MV.IOVector T.Text
+
 type BufData :: Type
 data BufData
   = BufData
@@ -80,8 +109,37 @@ type Handle :: Type -> Type
 data Handle prog
   = Handle {-# UNPACK #-} !(ForeignPtr Internal.Souffle)
            {-# UNPACK #-} !(MVar BufData)
+           {-# UNPACK #-} !(MVar SymbolCache)
+           !Relations
 type role Handle nominal
 
+-- | All relations of a program, in the same order as the facts in
+--   'ProgramFacts'. These are looked up once when the handle is created,
+--   so later operations don't need to look up a relation by name.
+type Relations :: Type
+type Relations = V.Vector (Ptr Internal.Relation)
+
+-- | Returns the relation for a fact, by its position in 'ProgramFacts'.
+lookupRelation :: forall prog a. ContainsFact prog a
+               => Handle prog -> Proxy a -> Ptr Internal.Relation
+lookupRelation (Handle _ _ _ relations) _ =
+  V.unsafeIndex relations $ fromIntegral $ natVal (Proxy @(FactIndex prog (ProgramFacts prog) a))
+{-# INLINABLE lookupRelation #-}
+
+-- | A helper typeclass, for collecting the names of all facts of a program.
+--   Needed for looking up all relations when a program is initialized.
+type FactNames :: [Type] -> Constraint
+class FactNames facts where
+  factNames :: Proxy facts -> [String]
+
+instance FactNames '[] where
+  factNames = const []
+  {-# INLINABLE factNames #-}
+
+instance (Fact a, FactNames as) => FactNames (a ': as) where
+  factNames _ = factName (Proxy @a) : factNames (Proxy @as)
+  {-# INLINABLE factNames #-}
+
 -- | A monad for executing Souffle-related actions in.
 type SouffleM :: Type -> Type
 newtype SouffleM a = SouffleM (IO a)
@@ -92,11 +150,13 @@ newtype SouffleM a = SouffleM (IO a)
 
      The 2nd argument is passed in a handle after initialization of the
      Souffle program. The handle will contain 'Nothing' if it failed to
-     load the Souffle C++ program. In the successful case it will contain
+     load the Souffle C++ program, or if one of the facts in 'ProgramFacts'
+     refers to a relation that is not part of the program. In the
+     successful case it will contain
      a handle that can be used for performing Souffle related actions
      using the other functions in this module.
 -}
-runSouffle :: forall prog a. Program prog
+runSouffle :: forall prog a. (Program prog, FactNames (ProgramFacts prog))
            => prog -> (Maybe (Handle prog) -> SouffleM a) -> IO a
 runSouffle prog action =
   let progName = programName prog
@@ -107,16 +167,22 @@ runSouffle prog action =
             bufData <- liftIO $ do
               ptr <- newForeignPtr_ nullPtr
               newMVar $ BufData ptr 0
-            pure $ Just $ Handle souffleHandle bufData
+            symbolCache <- liftIO $ newMVar =<< MV.new 0
+            relations <- liftIO $ V.fromList <$>
+              traverse (Internal.getRelation souffleHandle) (factNames (Proxy @(ProgramFacts prog)))
+            pure $ if V.any (== nullPtr) relations
+              then Nothing
+              else Just $ Handle souffleHandle bufData symbolCache relations
         action maybeHandle
    in result
 {-# INLINABLE runSouffle #-}
 
 -- | A monad used solely for marshalling and unmarshalling
---   between Haskell and Souffle Datalog. This fast variant is used when the
---   marshalling from Haskell to C++ and the exact size of a datastructure
---   is statically known (read: data type contains no string-like types),
---   or when marshalling from C++ to Haskell (pointer is then managed by C++).
+--   between Haskell and Souffle Datalog. When marshalling from Haskell to C++,
+--   the buffer needs to be large enough upfront: the exact size is either
+--   statically known (read: data type contains no string-like types), or
+--   computed beforehand using 'CMarshalSize'. When marshalling from C++ to
+--   Haskell, the pointer is managed by C++.
 type CMarshalFast :: Type -> Type
 newtype CMarshalFast a = CMarshalFast (StateT (Ptr ByteBuf) IO a)
   deriving (Functor, Applicative, Monad, MonadIO, MonadState (Ptr ByteBuf))
@@ -154,8 +220,13 @@ instance MonadPush CMarshalFast where
   {-# INLINABLE pushFloat #-}
   pushString str = pushText $ T.pack str
   {-# INLINABLE pushString #-}
-  pushText _ =
-    error "Fast marshalling does not support serializing string-like values."
+  pushText (TI.Text arr offset len) = do
+    -- NOTE: the buffer is sized upfront (see 'exactNumBytes'), and text is
+    -- UTF-8 encoded already, so the bytes can be copied over directly.
+    pushUInt32 (fromIntegral len)
+    ptr <- gets castPtr
+    liftIO $ TA.copyToPointer arr offset ptr len
+    put $ ptr `plusPtr` len
   {-# INLINABLE pushText #-}
 
 instance MonadPop CMarshalFast where
@@ -181,103 +252,129 @@ instance MonadPop CMarshalFast where
   {-# INLINABLE popText #-}
 
 
-type MarshalState :: Type
-data MarshalState
-  = MarshalState
-  { _buf :: {-# UNPACK #-} !BufData
-  , _ptr :: {-# UNPACK #-} !(Ptr ByteBuf)
-  , _ptrOffset :: {-# UNPACK #-} !Int
+type CachedState :: Type
+data CachedState
+  = CachedState
+  { _cachePtr :: {-# UNPACK #-} !(Ptr ByteBuf)
+  , _symbolCache :: !SymbolCache
   }
 
--- | A monad used solely for marshalling from Haskell to Souffle Datalog (C++).
---   This slow variant is used when the exact size of a datastructure is *not*
---   statically known (read: data type contains string-like types).
-type CMarshalSlow :: Type -> Type
-newtype CMarshalSlow a = CMarshalSlow (StateT MarshalState IO a)
-  deriving (Functor, Applicative, Monad, MonadIO, MonadState MarshalState)
-  via (StateT MarshalState IO)
-
-runMarshalSlowM :: BufData -> Int -> CMarshalSlow a -> IO a
-runMarshalSlowM bufData byteCount (CMarshalSlow m) = do
-  bufData' <- if bufSize bufData > byteCount
-    then pure bufData
-    else flip BufData byteCount <$> allocateBuf byteCount
-  let ptr = unsafeForeignPtrToPtr (bufPtr bufData')
-  evalStateT m $ MarshalState bufData' ptr 0
-{-# INLINABLE runMarshalSlowM #-}
-
-resizeBufWhenNeeded :: ByteCount -> CMarshalSlow ()
-resizeBufWhenNeeded byteCount = do
-  MarshalState bufData _ offset <- get
-  let totalByteCount = bufSize bufData
-  when (byteCount + offset > totalByteCount) $ do
-    let newTotalByteCount = getNewTotalByteCount byteCount offset totalByteCount
-    newBuf <- allocateBuf newTotalByteCount
-    copyBuf newBuf (bufPtr bufData) totalByteCount
-    let newPtr = unsafeForeignPtrToPtr newBuf
-        bufData' = BufData newBuf newTotalByteCount
-    put $ MarshalState bufData' (newPtr `plusPtr` offset) offset
-{-# INLINABLE resizeBufWhenNeeded #-}
-
-allocateBuf :: MonadIO m => ByteCount -> m (ForeignPtr ByteBuf)
-allocateBuf byteCount = liftIO $
-  mallocForeignPtrBytes byteCount
-{-# INLINABLE allocateBuf #-}
-
-copyBuf :: ForeignPtr ByteBuf -> ForeignPtr ByteBuf -> Int -> CMarshalSlow ()
-copyBuf dst src byteCount = liftIO $
-  withForeignPtr src $ \srcPtr ->
-  withForeignPtr dst $ \dstPtr ->
-    copyBytes dstPtr srcPtr byteCount
-{-# INLINABLE copyBuf #-}
-
-getNewTotalByteCount :: ByteCount -> Int -> ByteCount -> ByteCount
-getNewTotalByteCount byteCount offset = go where
-  go totalByteCount
-    | byteCount + offset > totalByteCount = go (totalByteCount * 2)
-    | otherwise = totalByteCount
-{-# INLINABLE getNewTotalByteCount #-}
-
-incrementPtr :: ByteCount -> CMarshalSlow ()
-incrementPtr byteCount =
-  modify $ \(MarshalState buf ptr offset) ->
-    MarshalState buf (ptr `plusPtr` byteCount) (offset + byteCount)
-{-# INLINABLE incrementPtr #-}
-
-instance MonadPush CMarshalSlow where
-  pushInt32 = writeAsBytesSlow
+-- | A monad used solely for unmarshalling from Souffle Datalog to Haskell,
+--   in case Souffle serialized symbols using the symbol cache (see
+--   'getFactsCached'). Symbols that were seen before are looked up in the
+--   cache, instead of being decoded again.
+type CMarshalCached :: Type -> Type
+newtype CMarshalCached a = CMarshalCached (StateT CachedState IO a)
+  deriving (Functor, Applicative, Monad, MonadIO, MonadState CachedState)
+  via (StateT CachedState IO)
+
+runMarshalCachedM :: CMarshalCached a -> Ptr ByteBuf -> SymbolCache
+                  -> IO (a, SymbolCache)
+runMarshalCachedM (CMarshalCached m) ptr cache = do
+  (a, CachedState _ cache') <- runStateT m $ CachedState ptr cache
+  pure (a, cache')
+{-# INLINABLE runMarshalCachedM #-}
+
+readAsBytesCached :: (S.Storable a, Marshal a) => CMarshalCached a
+readAsBytesCached = do
+  CachedState ptr cache <- get
+  a <- liftIO $ S.peek (castPtr ptr)
+  put $ CachedState (ptr `plusPtr` ramDomainSize) cache
+  pure a
+{-# INLINABLE readAsBytesCached #-}
+
+instance MonadPop CMarshalCached where
+  popInt32 = readAsBytesCached
+  {-# INLINABLE popInt32 #-}
+  popUInt32 = readAsBytesCached
+  {-# INLINABLE popUInt32 #-}
+  popFloat = readAsBytesCached
+  {-# INLINABLE popFloat #-}
+  popString = T.unpack <$> popText
+  {-# INLINABLE popString #-}
+  popText = do
+    tag <- popUInt32
+    let symbolId = fromIntegral $ tag `shiftR` 1
+        isNew = tag .&. 1 == 1
+    if tag == uncachedSymbolTag
+      then popTextUncached
+      else if not isNew
+      then liftIO . flip MV.unsafeRead symbolId =<< gets _symbolCache
+      else do
+        txt <- popTextUncached
+        CachedState ptr cache <- get
+        let cacheSize = MV.length cache
+        cache' <- if symbolId < cacheSize
+          then pure cache
+          else liftIO $ MV.grow cache $ max (symbolId + 1 - cacheSize) cacheSize
+        liftIO $ MV.unsafeWrite cache' symbolId txt
+        put $ CachedState ptr cache'
+        pure txt
+  {-# INLINABLE popText #-}
+
+-- | Tag used by Souffle for symbols with an id that is too large to be
+--   cached. These symbols are always followed by their string.
+uncachedSymbolTag :: Word32
+uncachedSymbolTag = maxBound
+
+-- | Reads the string of a symbol that follows its tag.
+popTextUncached :: CMarshalCached T.Text
+popTextUncached = do
+  byteCount <- fromIntegral <$> popUInt32
+  CachedState ptr cache <- get
+  txt <- if byteCount == 0
+    then pure T.empty
+    else liftIO $ do
+      bs <- BSU.unsafePackCStringLen (castPtr ptr, byteCount)
+      -- NOTE: $! is needed here to force the text value. A copy needs to
+      -- be made, before the bytearray is overwritten.
+      pure $! TB.toText $ TB.unsafeFromByteString bs
+  put $ CachedState (ptr `plusPtr` byteCount) cache
+  pure txt
+{-# INLINABLE popTextUncached #-}
+
+
+-- | A monad used solely for computing the exact amount of bytes needed to
+--   marshal data from Haskell to Souffle Datalog (C++), for data types that
+--   contain string-like values. This makes it possible to allocate the
+--   buffer once, and then use 'CMarshalFast' for the actual marshalling.
+type CMarshalSize :: Type -> Type
+newtype CMarshalSize a = CMarshalSize (State ByteCount a)
+  deriving (Functor, Applicative, Monad, MonadState ByteCount)
+  via (State ByteCount)
+
+exactNumBytes :: (Foldable f, Marshal a) => f a -> ByteCount
+exactNumBytes fa =
+  let (CMarshalSize m) = traverse_ push fa
+   in execState m 0
+{-# INLINABLE exactNumBytes #-}
+
+instance MonadPush CMarshalSize where
+  pushInt32 _ = modify' (+ ramDomainSize)
   {-# INLINABLE pushInt32 #-}
-  pushUInt32 = writeAsBytesSlow
+  pushUInt32 _ = modify' (+ ramDomainSize)
   {-# INLINABLE pushUInt32 #-}
-  pushFloat = writeAsBytesSlow
+  pushFloat _ = modify' (+ ramDomainSize)
   {-# INLINABLE pushFloat #-}
-  pushString str = pushText $ T.pack str
+  pushString str = modify' (+ (ramDomainSize + utf8Length str))
   {-# INLINABLE pushString #-}
-  pushText txt = do
-    let bs = TE.encodeUtf8 txt  -- TODO: is it possible to get rid of this copy?
-        len = BS.length bs
-    resizeBufWhenNeeded (ramDomainSize + len)
-    pushUInt32 (fromIntegral len)
-    if len == 0
-      then pure ()
-      else do
-        ptr <- gets (castPtr . _ptr)
-        liftIO $ BSU.unsafeUseAsCString bs $ flip (copyBytes ptr) len
-        incrementPtr len
+  pushText (TI.Text _ _ len) = modify' (+ (ramDomainSize + len))
   {-# INLINABLE pushText #-}
 
-writeAsBytesSlow :: (S.Storable a, Marshal a) => a -> CMarshalSlow ()
-writeAsBytesSlow a = do
-  resizeBufWhenNeeded ramDomainSize
-  ptr <- gets (castPtr . _ptr)
-  liftIO $ S.poke ptr a
-  incrementPtr ramDomainSize
-{-# INLINABLE writeAsBytesSlow #-}
+-- | Number of bytes needed to encode a string using UTF-8.
+utf8Length :: String -> ByteCount
+utf8Length = foldl' (\acc c -> acc + charLength (ord c)) 0 where
+  charLength x
+    | x < 0x80 = 1
+    | x < 0x800 = 2
+    | x < 0x10000 = 3
+    | otherwise = 4
+{-# INLINABLE utf8Length #-}
 
 
 type Collect :: (Type -> Type) -> Constraint
 class Collect c where
-  collect :: Marshal a => Word32 -> CMarshalFast (c a)
+  collect :: (Marshal a, MonadPop m, MonadIO m) => Word32 -> m (c a)
 
 instance Collect [] where
   collect objCount = go objCount [] where
@@ -308,7 +405,8 @@ instance Collect (A.Array Int) where
     collect' ma 0
     where
       objCount' = fromIntegral objCount
-      collect' :: Marshal a => A.IOArray Int a -> Int -> CMarshalFast (A.Array Int a)
+      collect' :: (Marshal a, MonadPop m, MonadIO m)
+               => A.IOArray Int a -> Int -> m (A.Array Int a)
       collect' array idx
         | idx == objCount' = liftIO $ A.unsafeFreeze array
         | otherwise = do
@@ -327,75 +425,542 @@ instance MonadSouffle SouffleM where
   type CollectFacts SouffleM c = Collect c
   type SubmitFacts SouffleM a = Submit a
 
-  run (Handle prog _) = SouffleM $ Internal.run prog
+  run (Handle prog _ _ _) = SouffleM $ Internal.run prog
   {-# INLINABLE run #-}
 
-  setNumThreads (Handle prog _) numCores =
+  setNumThreads (Handle prog _ _ _) numCores =
     SouffleM $ Internal.setNumThreads prog numCores
   {-# INLINABLE setNumThreads #-}
 
-  getNumThreads (Handle prog _) =
+  getNumThreads (Handle prog _ _ _) =
     SouffleM $ Internal.getNumThreads prog
   {-# INLINABLE getNumThreads #-}
 
   addFact :: forall a prog. (Fact a, ContainsInputFact prog a, Submit a)
           => Handle prog -> a -> SouffleM ()
-  addFact (Handle prog bufVar) fact = liftIO $ do
-    let relationName = factName (Proxy :: Proxy a)
-    relation <- Internal.getRelation prog relationName
+  addFact handle@(Handle _ bufVar _ _) fact = liftIO $ do
+    let relation = lookupRelation handle (Proxy @a)
     writeBytes bufVar relation (Identity fact)
   {-# INLINABLE addFact #-}
 
   addFacts :: forall t a prog. (Foldable t, Fact a, ContainsInputFact prog a, Submit a)
            => Handle prog -> t a -> SouffleM ()
-  addFacts (Handle prog bufVar) facts = liftIO $ do
-    let relationName = factName (Proxy :: Proxy a)
-    relation <- Internal.getRelation prog relationName
+  addFacts handle@(Handle _ bufVar _ _) facts = liftIO $ do
+    let relation = lookupRelation handle (Proxy @a)
     writeBytes bufVar relation facts
   {-# INLINABLE addFacts #-}
 
   getFacts :: forall a c prog. (Fact a, ContainsOutputFact prog a, Collect c)
            => Handle prog -> SouffleM (c a)
-  getFacts (Handle prog _) = SouffleM $ do
-    let relationName = factName (Proxy :: Proxy a)
-    relation <- Internal.getRelation prog relationName
+  getFacts handle@(Handle prog _ _ _) = SouffleM $ do
+    let relation = lookupRelation handle (Proxy @a)
     buf <- withForeignPtr prog $ flip Internal.popFacts relation
     flip runMarshalFastM buf $ collect =<< popUInt32
   {-# INLINABLE getFacts #-}
 
   findFact :: forall a prog. (Fact a, ContainsOutputFact prog a, Submit a)
            => Handle prog -> a -> SouffleM (Maybe a)
-  findFact (Handle prog bufVar) fact = SouffleM $ do
-    let relationName = factName (Proxy :: Proxy a)
-    relation <- Internal.getRelation prog relationName
-    found <- case estimateNumBytes (Proxy @a) of
-      Exact numBytes -> do
-        modifyMVarMasked bufVar $ \bufData -> do
-          bufData' <- if bufSize bufData > numBytes
-            then pure bufData
-            else flip BufData numBytes <$> allocateBuf numBytes
-          found <- withForeignPtr (bufPtr bufData') $ \ptr -> do
-            runMarshalFastM (push fact) ptr
-            Internal.containsFact relation ptr
-          pure (bufData', found)
-      Estimated numBytes -> modifyMVarMasked bufVar $ \bufData ->
-        runMarshalSlowM bufData numBytes $ do
-          push fact
-          bufData' <- gets _buf
-          liftIO $ withForeignPtr (bufPtr bufData') $ \ptr -> do
-            found <- Internal.containsFact relation ptr
-            pure (bufData', found)
+  findFact handle@(Handle _ bufVar _ _) fact = SouffleM $ do
+    let relation = lookupRelation handle (Proxy @a)
+        numBytes = case estimateNumBytes (Proxy @a) of
+          Exact byteCount -> byteCount
+          Estimated _ -> exactNumBytes (Identity fact)
+    found <- modifyMVarMasked bufVar $ \bufData -> do
+      bufData' <- if bufSize bufData > numBytes
+        then pure bufData
+        else flip BufData numBytes <$> allocateBuf numBytes
+      found <- withForeignPtr (bufPtr bufData') $ \ptr -> do
+        runMarshalFastM (push fact) ptr
+        Internal.containsFact relation ptr
+      pure (bufData', found)
     pure $ if found then Just fact else Nothing
   {-# INLINABLE findFact #-}
 
+{- | Returns all facts of a relation as a storable vector.
+
+     Contrary to 'getFacts', the facts are not unmarshalled one by one.
+     Instead they are copied directly by the C++ side into a pinned buffer
+     that is then used as the backing memory of the vector, without any
+     additional copies. This only works for facts that contain no string-like
+     fields. The 'S.Storable' instance of the fact needs to use the same layout
+     as Souffle: every field is stored as a 4 byte value, in the same order as
+     the fields are defined in the Datalog program.
+-}
+getFactsStorable :: forall a prog. (Fact a, ContainsOutputFact prog a, StorableFact a)
+                 => Handle prog -> SouffleM (SV.Vector a)
+getFactsStorable handle = SouffleM $ do
+  let relationName = factName (Proxy :: Proxy a)
+      relation = lookupRelation handle (Proxy @a)
+      numBytes = case estimateNumBytes (Proxy @a) of
+        Exact byteCount
+          | byteCount == S.sizeOf (undefined :: a) -> byteCount
+          | otherwise -> error $ "Storable instance for " <> relationName
+                              <> " does not match the layout used by Souffle."
+        Estimated _ -> error "Unreachable: storable facts have an exact size."
+  objCount <- Internal.getRelationSize relation
+  fptr <- mallocForeignPtrBytes (fromIntegral objCount * numBytes)
+  count <- withForeignPtr fptr $ \ptr ->
+    Internal.popFactsInto relation (castPtr ptr) objCount
+  pure $ SV.unsafeFromForeignPtr0 fptr (fromIntegral count)
+{-# INLINABLE getFactsStorable #-}
+
+{- | Enables (or disables) a Bloom filter for a relation, which speeds up
+     'findFact' for facts that are /not/ part of the relation.
+
+     This is useful when a relation is large and most lookups are expected to
+     fail. The filter is built on the first lookup and is kept up to date when
+     facts are added. It is rebuilt lazily after the program has run.
+-}
+useBloomFilter :: forall a prog. (Fact a, ContainsOutputFact prog a)
+               => Handle prog -> Proxy a -> Bool -> SouffleM ()
+useBloomFilter handle _ enable = SouffleM $ do
+  let relation = lookupRelation handle (Proxy @a)
+  Internal.useBloomFilter relation enable
+{-# INLINABLE useBloomFilter #-}
+
+{- | Freezes a relation, after it is no longer expected to change.
+
+     This creates a read-only snapshot of the relation that stores all facts
+     in a compact array, which speeds up 'getFacts' and 'findFact' for
+     relations that are queried many times. The snapshot is discarded when
+     facts are added to the relation, or when the program is run again.
+-}
+freezeRelation :: forall a prog. (Fact a, ContainsOutputFact prog a)
+               => Handle prog -> Proxy a -> SouffleM ()
+freezeRelation handle _ = SouffleM $ do
+  let relation = lookupRelation handle (Proxy @a)
+  Internal.freezeRelation relation
+{-# INLINABLE freezeRelation #-}
+
+{- | Returns part of the facts of a relation: at most "limit" facts, starting
+     at the given offset (in the same order as 'getFacts').
+
+     Only the requested facts are copied and sent to Haskell. If the relation
+     is frozen (see 'freezeRelation'), only the requested facts are visited,
+     which makes it possible to page through large relations efficiently.
+-}
+getFactsRange :: forall a c prog. (Fact a, ContainsOutputFact prog a, Collect c)
+              => Handle prog -> Word64 -> Word64 -> SouffleM (c a)
+getFactsRange handle@(Handle prog _ _ _) offset limit = SouffleM $ do
+  let relation = lookupRelation handle (Proxy @a)
+  buf <- withForeignPtr prog $ \ptr -> Internal.popFactsRange ptr relation offset limit
+  flip runMarshalFastM buf $ collect =<< popUInt32
+{-# INLINABLE getFactsRange #-}
+
+{- | Returns a uniform random sample of distinct facts of a relation, containing
+     the given amount of facts (or all facts, if the relation is smaller).
+     The same seed returns the same sample, as long as the relation didn't
+     change.
+
+     Only the sampled facts are copied and sent to Haskell.
+-}
+getFactsSample :: forall a c prog. (Fact a, ContainsOutputFact prog a, Collect c)
+               => Handle prog -> Word64 -> Word64 -> SouffleM (c a)
+getFactsSample handle@(Handle prog _ _ _) count seed = SouffleM $ do
+  let relation = lookupRelation handle (Proxy @a)
+  buf <- withForeignPtr prog $ \ptr -> Internal.popFactsSample ptr relation count seed
+  flip runMarshalFastM buf $ collect =<< popUInt32
+{-# INLINABLE getFactsSample #-}
+
+{- | Compares a relation of two programs, for example a baseline and a
+     candidate version of an analysis. Returns the facts that are only found
+     in the second program (added), and the facts that are only found in the
+     first program (removed).
+
+     The difference is computed by Souffle, so only the differing facts are
+     sent to Haskell. Relations that aren't frozen (see 'freezeRelation') are
+     only copied while the difference is computed.
+
+     Both programs need to be alive at the same time. To compare the results
+     of two runs of the same program, use 'snapshotFacts' and
+     'getFactsDiffSince' instead.
+-}
+getFactsDiff :: forall a c prog prog'. (Fact a, ContainsOutputFact prog a, ContainsOutputFact prog' a, Collect c)
+             => Handle prog -> Handle prog' -> SouffleM (c a, c a)
+getFactsDiff handle1@(Handle prog1 _ _ _) handle2@(Handle prog2 _ _ _) = SouffleM $ do
+  let relation1 = lookupRelation handle1 (Proxy @a)
+      relation2 = lookupRelation handle2 (Proxy @a)
+  buf <- withForeignPtr prog1 $ \ptr -> withForeignPtr prog2 $ \_ ->
+    Internal.diffFacts ptr relation1 relation2
+  flip runMarshalFastM buf $ do
+    removed <- collect =<< popUInt32
+    added <- collect =<< popUInt32
+    pure (added, removed)
+{-# INLINABLE getFactsDiff #-}
+
+-- | A copy of all facts of a relation at a certain point in time, created
+--   by 'snapshotFacts'. The type parameters keep track of the program and
+--   the fact the snapshot belongs to.
+type Snapshot :: Type -> Type -> Type
+newtype Snapshot prog a = Snapshot (ForeignPtr Internal.Snapshot)
+type role Snapshot nominal nominal
+
+{- | Creates a snapshot of all facts of a relation. The snapshot is not
+     affected by adding facts or running the program again, so it can be
+     compared with the relation later on using 'getFactsDiffSince'.
+
+     A snapshot can only be compared with the relation of the handle it was
+     created from, and only inside the same call to 'runSouffle'.
+-}
+snapshotFacts :: forall a prog. (Fact a, ContainsOutputFact prog a)
+              => Handle prog -> Proxy a -> SouffleM (Snapshot prog a)
+snapshotFacts handle@(Handle prog _ _ _) proxy = SouffleM $ do
+  let relation = lookupRelation handle proxy
+  withForeignPtr prog $ \_ -> Snapshot <$> Internal.snapshotRelation relation
+{-# INLINABLE snapshotFacts #-}
+
+{- | Compares a relation with a snapshot that was taken earlier (see
+     'snapshotFacts'), for example before running the program again.
+     Returns the facts that are only found in the relation (added), and the
+     facts that are only found in the snapshot (removed).
+
+     Like 'getFactsDiff', only the differing facts are sent to Haskell.
+-}
+getFactsDiffSince :: forall a c prog. (Fact a, ContainsOutputFact prog a, Collect c)
+                  => Handle prog -> Snapshot prog a -> SouffleM (c a, c a)
+getFactsDiffSince handle@(Handle prog _ _ _) (Snapshot snapshot) = SouffleM $ do
+  let relation = lookupRelation handle (Proxy @a)
+  buf <- withForeignPtr prog $ \ptr ->
+    Internal.diffFactsSince ptr snapshot relation
+  flip runMarshalFastM buf $ do
+    removed <- collect =<< popUInt32
+    added <- collect =<< popUInt32
+    pure (added, removed)
+{-# INLINABLE getFactsDiffSince #-}
+
+{- | Returns all facts of a relation, using a symbol cache.
+
+     This is an alternative to 'getFacts' for relations that contain symbols
+     that are returned many times (for example when the same relation is
+     queried repeatedly). Souffle only serializes the string of a symbol the
+     first time it is returned for a handle, afterwards only the symbol id is
+     sent. All facts returned this way share a single 'T.Text' value for the
+     same symbol.
+
+     Note that the cache grows with the number of distinct symbols returned
+     and is only freed when the handle is no longer used.
+-}
+getFactsCached :: forall a c prog. (Fact a, ContainsOutputFact prog a, Collect c)
+               => Handle prog -> SouffleM (c a)
+getFactsCached handle@(Handle prog _ cacheVar _) = SouffleM $ do
+  let relation = lookupRelation handle (Proxy @a)
+  modifyMVarMasked cacheVar $ \cache -> withForeignPtr prog $ \ptr -> do
+    buf <- Internal.popFactsCached ptr relation
+    -- NOTE: if unmarshalling fails part-way, Souffle already marked symbols
+    -- as sent that never made it into the cache. Souffle then forgets all
+    -- sent symbols, so both sides agree again on the next call.
+    (facts, cache') <- runMarshalCachedM (collect =<< popUInt32) buf cache
+      `onException` Internal.clearSymbolCache ptr
+    pure (cache', facts)
+{-# INLINABLE getFactsCached #-}
+
+{- | Adds multiple facts to the program, marshalling them on multiple threads.
+
+     This is an alternative to 'addFacts' for large batches of facts. The
+     facts are split into one chunk per capability (see 'getNumCapabilities').
+     The exact size of each chunk is computed first, after which the chunks
+     are marshalled concurrently into disjoint regions of a single buffer.
+     Afterwards, all facts are passed to Souffle at once.
+-}
+addFactsParallel :: forall t a prog. (Foldable t, Fact a, ContainsInputFact prog a, Submit a)
+                 => Handle prog -> t a -> SouffleM ()
+addFactsParallel handle@(Handle _ bufVar _ _) facts = liftIO $ do
+  capabilityCount <- getNumCapabilities
+  let relation = lookupRelation handle (Proxy @a)
+      objCount = length facts
+      chunks = chunksOf (chunkSize objCount capabilityCount) (toList facts)
+  byteCounts <- case estimateNumBytes (Proxy @a) of
+    Exact numBytes -> pure $ map ((* numBytes) . length) chunks
+    Estimated _ -> concurrently $ map (evaluate . exactNumBytes) chunks
+  let offsets = scanl (+) 0 byteCounts
+      totalByteCount = sum byteCounts
+  modifyMVarMasked_ bufVar $ \bufData -> do
+    bufData' <- if bufSize bufData > totalByteCount
+      then pure bufData
+      else flip BufData totalByteCount <$> allocateBuf totalByteCount
+    withForeignPtr (bufPtr bufData') $ \ptr -> do
+      concurrently_ $ flip map (zip offsets chunks) $ \(offset, chunk) ->
+        runMarshalFastM (traverse_ push chunk) (ptr `plusPtr` offset)
+      Internal.pushFacts relation ptr (fromIntegral objCount)
+    pure bufData'
+{-# INLINABLE addFactsParallel #-}
+
+{- | Adds multiple facts to the program, overlapping marshalling and insertion.
+
+     This is an alternative to 'addFacts' for large batches of facts. The
+     facts are split into chunks of the given size. While Souffle inserts a
+     chunk on a separate thread, the next chunk is marshalled already, so the
+     total time approaches the slowest of both steps instead of their sum.
+     A small ring of buffers is reused for the chunks, so memory usage depends
+     on the chunk size instead of on the size of the whole batch.
+-}
+addFactsPipelined :: forall t a prog. (Foldable t, Fact a, ContainsInputFact prog a, Submit a)
+                  => Handle prog -> Int -> t a -> SouffleM ()
+addFactsPipelined handle factsPerChunk facts = liftIO $ do
+  let relation = lookupRelation handle (Proxy @a)
+      chunks = chunksOf (max 1 factsPerChunk) (toList facts)
+  ring <- MV.replicateM pipelineDepth $ BufData <$> newForeignPtr_ nullPtr <*> pure 0
+  flip finally (touchRing ring) $ Internal.withPipeline relation $ \pipeline ->
+    for_ (zip [0..] chunks) $ \(idx, chunk) -> do
+      let slot = idx `mod` pipelineDepth
+          objCount = length chunk
+          totalByteCount = case estimateNumBytes (Proxy @a) of
+            Exact numBytes -> numBytes * objCount
+            Estimated _ -> exactNumBytes chunk
+      -- NOTE: the buffer in this slot can only be reused after the chunk that
+      -- was marshalled into it before is inserted.
+      Internal.waitForPipeline pipeline $ fromIntegral $ max 0 (idx - pipelineDepth + 1)
+      bufData <- MV.unsafeRead ring slot
+      bufData' <- if bufSize bufData > totalByteCount
+        then pure bufData
+        else flip BufData totalByteCount <$> allocateBuf totalByteCount
+      MV.unsafeWrite ring slot bufData'
+      withForeignPtr (bufPtr bufData') $ \ptr -> do
+        runMarshalFastM (traverse_ push chunk) ptr
+        Internal.pushFactsPipelined pipeline ptr (fromIntegral objCount)
+  where
+    -- The buffers need to stay alive until the pipeline is finished.
+    touchRing ring =
+      for_ [0 .. pipelineDepth - 1] $ \slot ->
+        touchForeignPtr . bufPtr =<< MV.unsafeRead ring slot
+{-# INLINABLE addFactsPipelined #-}
+
+-- | The amount of buffers used by 'addFactsPipelined'.
+pipelineDepth :: Int
+pipelineDepth = 3
+
+{- | Returns all facts of a relation, unmarshalling them on multiple threads.
+
+     This is an alternative to 'getFacts' for large relations. Souffle splits
+     the serialized facts into one chunk per capability (see
+     'getNumCapabilities'), and exports where each chunk starts. The chunks
+     are then unmarshalled concurrently into a single vector.
+-}
+getFactsParallel :: forall a prog. (Fact a, ContainsOutputFact prog a)
+                 => Handle prog -> SouffleM (V.Vector a)
+getFactsParallel handle@(Handle prog _ _ _) = SouffleM $ do
+  chunkCount <- getNumCapabilities
+  let relation = lookupRelation handle (Proxy @a)
+  (buf, offsets) <- allocaArray chunkCount $ \offsetsPtr -> do
+    buf <- withForeignPtr prog $ \ptr ->
+      Internal.popFactsChunked ptr relation (fromIntegral chunkCount) offsetsPtr
+    offsets <- peekArray chunkCount offsetsPtr
+    pure (buf, offsets)
+  objCount <- fromIntegral <$> (S.peek (castPtr buf) :: IO Word32)
+  let size = chunkSize objCount chunkCount
+      starts = takeWhile (< objCount) [0, size ..]
+  vm <- MV.unsafeNew objCount
+  concurrently_ $ flip map (zip starts offsets) $ \(start, offset) ->
+    flip runMarshalFastM (buf `plusPtr` fromIntegral offset) $
+      flip traverse_ [start .. min objCount (start + size) - 1] $ \idx -> do
+        !obj <- pop
+        liftIO $ MV.unsafeWrite vm idx obj
+  V.unsafeFreeze vm
+{-# INLINABLE getFactsParallel #-}
+
+{- | Adds multiple facts to the program, using a fixed layout codec.
+
+     This is a faster alternative to 'addFacts' for facts that contain no
+     string-like fields. The codec is derived once per fact type from its
+     'Generic' representation, so every fact is written directly at fixed
+     offsets in the buffer instead of going through 'Marshal' field by field.
+     The layout is checked against the one published by Souffle for the
+     relation, an exception is thrown if they do not match.
+-}
+addFactsFixed :: forall t a prog. (Foldable t, Fact a, ContainsInputFact prog a, FixedFact a)
+              => Handle prog -> t a -> SouffleM ()
+addFactsFixed handle@(Handle _ bufVar _ _) facts = liftIO $ do
+  let relationName = factName (Proxy :: Proxy a)
+      relation = lookupRelation handle (Proxy @a)
+  checkFixedLayout (Proxy @a) relationName relation
+  modifyMVarMasked_ bufVar $ \bufData -> do
+    let totalByteCount = numBytes * objCount
+    bufData' <- if bufSize bufData > totalByteCount
+      then pure bufData
+      else flip BufData totalByteCount <$> allocateBuf totalByteCount
+    withForeignPtr (bufPtr bufData') $ \ptr -> do
+      foldM_ (\offset fact -> (offset + numBytes) <$ pokeFixed ptr offset fact) 0 facts
+      Internal.pushFacts relation ptr (fromIntegral objCount)
+    pure bufData'
+  where
+    objCount = length facts
+    numBytes = fixedByteCount (Proxy @a)
+{-# INLINABLE addFactsFixed #-}
+
+{- | Returns all facts of a relation, using a fixed layout codec.
+
+     This is a faster alternative to 'getFacts' for facts that contain no
+     string-like fields, see 'addFactsFixed' for more information.
+-}
+getFactsFixed :: forall a prog. (Fact a, ContainsOutputFact prog a, FixedFact a)
+              => Handle prog -> SouffleM (V.Vector a)
+getFactsFixed handle@(Handle prog _ _ _) = SouffleM $ do
+  let relationName = factName (Proxy :: Proxy a)
+      numBytes = fixedByteCount (Proxy @a)
+      relation = lookupRelation handle (Proxy @a)
+  checkFixedLayout (Proxy @a) relationName relation
+  buf <- withForeignPtr prog $ flip Internal.popFacts relation
+  objCount <- S.peek (castPtr buf) :: IO Word32
+  let ptr = buf `plusPtr` ramDomainSize
+  V.generateM (fromIntegral objCount) $ \idx -> peekFixed ptr (idx * numBytes)
+{-# INLINABLE getFactsFixed #-}
+
+checkFixedLayout :: forall a. ToLayout (GetFields (Rep a))
+                 => Proxy a -> String -> Ptr Internal.Relation -> IO ()
+checkFixedLayout _ relationName relation = do
+  layout <- Internal.getRelationLayout relation
+  let expected = toLayout (Proxy @(GetFields (Rep a)))
+  when (layout /= expected) $
+    throwIO $ ErrorCall $ "Fixed layout for " <> relationName <> " (" <> expected
+                       <> ") does not match the layout used by Souffle (" <> layout <> ")."
+{-# INLINABLE checkFixedLayout #-}
+
 instance MonadSouffleFileIO SouffleM where
-  loadFiles (Handle prog _) = SouffleM . Internal.loadAll prog
+  loadFiles (Handle prog _ _ _) = SouffleM . Internal.loadAll prog
   {-# INLINABLE loadFiles #-}
 
-  writeFiles (Handle prog _) = SouffleM . Internal.printAll prog
+  writeFiles (Handle prog _ _ _) = SouffleM . Internal.printAll prog
   {-# INLINABLE writeFiles #-}
 
 
+-- | A helper typeclass constraint, needed to copy Datalog facts directly
+--   from C++ into a storable vector. Only facts that consist solely of
+--   numeric fields (no string-like values) satisfy this constraint.
+type StorableFact :: Type -> Constraint
+type StorableFact a = (Submit a, S.Storable a, OnlyNumericFields a (GetFields (Rep a)))
+
+type OnlyNumericFields :: Type -> [Type] -> Constraint
+type family OnlyNumericFields a fields where
+  OnlyNumericFields _ '[] = ()
+  OnlyNumericFields a (Int32 ': fs) = OnlyNumericFields a fs
+  OnlyNumericFields a (Word32 ': fs) = OnlyNumericFields a fs
+  OnlyNumericFields a (Float ': fs) = OnlyNumericFields a fs
+  OnlyNumericFields a (f ': _) = TypeError
+    ( 'Text "Cannot directly copy facts of type " ':<>: 'ShowType a ':<>: 'Text " between Haskell and Souffle."
+    ':$$: 'Text "Only numeric fields are supported, but it contains a field of type " ':<>: 'ShowType f ':<>: 'Text "."
+    )
+
+-- | A helper typeclass constraint, needed to marshal Datalog facts using a
+--   fixed layout (see 'addFactsFixed' and 'getFactsFixed'). Only facts that
+--   consist solely of numeric fields (no string-like values) satisfy this
+--   constraint.
+type FixedFact :: Type -> Constraint
+type FixedFact a =
+  ( Generic a
+  , GFixed (Rep a)
+  , ToLayout (GetFields (Rep a))
+  , OnlyNumericFields a (GetFields (Rep a))
+  )
+
+fixedByteCount :: forall a. GFixed (Rep a) => Proxy a -> ByteCount
+fixedByteCount _ = ramDomainSize * gfieldCount (Proxy @(Rep a))
+{-# INLINABLE fixedByteCount #-}
+
+pokeFixed :: (Generic a, GFixed (Rep a)) => Ptr ByteBuf -> Int -> a -> IO ()
+pokeFixed ptr offset = gpokeFixed ptr offset . from
+{-# INLINABLE pokeFixed #-}
+
+peekFixed :: (Generic a, GFixed (Rep a)) => Ptr ByteBuf -> Int -> IO a
+peekFixed ptr offset = to <$> gpeekFixed ptr offset
+{-# INLINABLE peekFixed #-}
+
+-- | A helper typeclass, for computing the layout of a list of fields,
+--   in the same format as returned by Souffle.
+type ToLayout :: [Type] -> Constraint
+class ToLayout fields where
+  toLayout :: Proxy fields -> String
+
+instance ToLayout '[] where
+  toLayout = const []
+  {-# INLINABLE toLayout #-}
+
+instance (LayoutChar a, ToLayout as) => ToLayout (a ': as) where
+  toLayout = const $ layoutChar (Proxy @a) : toLayout (Proxy @as)
+  {-# INLINABLE toLayout #-}
+
+type LayoutChar :: Type -> Constraint
+class LayoutChar a where
+  layoutChar :: Proxy a -> Char
+
+instance LayoutChar Int32 where
+  layoutChar = const 'i'
+  {-# INLINABLE layoutChar #-}
+
+instance LayoutChar Word32 where
+  layoutChar = const 'u'
+  {-# INLINABLE layoutChar #-}
+
+instance LayoutChar Float where
+  layoutChar = const 'f'
+  {-# INLINABLE layoutChar #-}
+
+-- | A helper typeclass, for writing and reading the generic representation
+--   of a fact at fixed offsets, without any intermediate monadic state.
+type GFixed :: (Type -> Type) -> Constraint
+class GFixed f where
+  gfieldCount :: Proxy f -> Int
+  gpokeFixed :: Ptr ByteBuf -> Int -> f x -> IO ()
+  gpeekFixed :: Ptr ByteBuf -> Int -> IO (f x)
+
+instance GFixed f => GFixed (M1 i c f) where
+  gfieldCount = const $ gfieldCount (Proxy @f)
+  {-# INLINABLE gfieldCount #-}
+  gpokeFixed ptr offset (M1 a) = gpokeFixed ptr offset a
+  {-# INLINABLE gpokeFixed #-}
+  gpeekFixed ptr offset = M1 <$> gpeekFixed ptr offset
+  {-# INLINABLE gpeekFixed #-}
+
+instance (GFixed f, GFixed g) => GFixed (f :*: g) where
+  gfieldCount = const $ gfieldCount (Proxy @f) + gfieldCount (Proxy @g)
+  {-# INLINABLE gfieldCount #-}
+  gpokeFixed ptr offset (a :*: b) = do
+    gpokeFixed ptr offset a
+    gpokeFixed ptr (offset + ramDomainSize * gfieldCount (Proxy @f)) b
+  {-# INLINABLE gpokeFixed #-}
+  gpeekFixed ptr offset =
+    (:*:) <$> gpeekFixed ptr offset
+          <*> gpeekFixed ptr (offset + ramDomainSize * gfieldCount (Proxy @f))
+  {-# INLINABLE gpeekFixed #-}
+
+instance FixedField (IsPrimitive a) a => GFixed (K1 i a) where
+  gfieldCount = const $ fixedFieldCount (Proxy @(IsPrimitive a)) (Proxy @a)
+  {-# INLINABLE gfieldCount #-}
+  gpokeFixed ptr offset (K1 a) = pokeField (Proxy @(IsPrimitive a)) ptr offset a
+  {-# INLINABLE gpokeFixed #-}
+  gpeekFixed ptr offset = K1 <$> peekField (Proxy @(IsPrimitive a)) ptr offset
+  {-# INLINABLE gpeekFixed #-}
+
+type IsPrimitive :: Type -> Bool
+type family IsPrimitive a where
+  IsPrimitive Int32 = 'True
+  IsPrimitive Word32 = 'True
+  IsPrimitive Float = 'True
+  IsPrimitive _ = 'False
+
+-- | Primitive fields are written directly, other fields are assumed to
+--   be (nested) product types and are written using their 'Generic' instance.
+type FixedField :: Bool -> Type -> Constraint
+class FixedField primitive a where
+  fixedFieldCount :: Proxy primitive -> Proxy a -> Int
+  pokeField :: Proxy primitive -> Ptr ByteBuf -> Int -> a -> IO ()
+  peekField :: Proxy primitive -> Ptr ByteBuf -> Int -> IO a
+
+instance S.Storable a => FixedField 'True a where
+  fixedFieldCount _ _ = 1
+  {-# INLINABLE fixedFieldCount #-}
+  pokeField _ = S.pokeByteOff
+  {-# INLINABLE pokeField #-}
+  peekField _ = S.peekByteOff
+  {-# INLINABLE peekField #-}
+
+instance (Generic a, GFixed (Rep a)) => FixedField 'False a where
+  fixedFieldCount _ _ = gfieldCount (Proxy @(Rep a))
+  {-# INLINABLE fixedFieldCount #-}
+  pokeField _ ptr offset = gpokeFixed ptr offset . from
+  {-# INLINABLE pokeField #-}
+  peekField _ ptr offset = to <$> gpeekFixed ptr offset
+  {-# INLINABLE peekField #-}
+
 type ByteSize :: Type
 data ByteSize
   = Exact {-# UNPACK #-} !ByteCount
@@ -474,25 +1039,42 @@ estimateNumBytes :: forall a. Submit a => Proxy a -> ByteSize
 estimateNumBytes _ = toByteSize (Proxy @(GetFields (Rep a)))
 {-# INLINABLE estimateNumBytes #-}
 
+-- | The amount of elements in each chunk, when splitting a number of
+--   elements into the given amount of chunks.
+chunkSize :: Int -> Int -> Int
+chunkSize count chunkCount = max 1 $ (count + chunkCount - 1) `div` chunkCount
+{-# INLINABLE chunkSize #-}
+
+chunksOf :: Int -> [a] -> [[a]]
+chunksOf n = go where
+  go [] = []
+  go xs = let (chunk, rest) = splitAt n xs in chunk : go rest
+{-# INLINABLE chunksOf #-}
+
+{- | Runs the actions concurrently and waits for all of them to finish.
+
+     This can be passed to 'Language.Souffle.Analysis.execAnalysisConcurrently'
+     to run independent analyses at the same time. Each action should use a
+     separate program handle.
+-}
+runConcurrently :: [SouffleM ()] -> SouffleM ()
+runConcurrently actions =
+  SouffleM $ concurrently_ $ map (\(SouffleM action) -> action) actions
+{-# INLINABLE runConcurrently #-}
+
 writeBytes :: forall f a. (Foldable f, Marshal a, Submit a)
            => MVar BufData -> Ptr Internal.Relation -> f a -> IO ()
-writeBytes bufVar relation fa = case estimateNumBytes (Proxy @a) of
-  Exact numBytes -> modifyMVarMasked_ bufVar $ \bufData -> do
-    let totalByteCount = numBytes * objCount
-    bufData' <- if bufSize bufData > totalByteCount
-      then pure bufData
-      else flip BufData totalByteCount <$> allocateBuf totalByteCount
-    withForeignPtr (bufPtr bufData') $ \ptr -> do
-      runMarshalFastM (traverse_ push fa) ptr
-      Internal.pushFacts relation ptr (fromIntegral objCount)
-    pure bufData'
-
-  Estimated numBytes -> modifyMVarMasked_ bufVar $ \bufData ->
-    runMarshalSlowM bufData (numBytes * objCount) $ do
-      traverse_ push fa
-      bufData' <- gets _buf
-      liftIO $ withForeignPtr (bufPtr bufData') $ \ptr -> do
-        Internal.pushFacts relation ptr (fromIntegral objCount)
-        pure bufData'
-  where objCount = length fa
+writeBytes bufVar relation fa = modifyMVarMasked_ bufVar $ \bufData -> do
+  bufData' <- if bufSize bufData > totalByteCount
+    then pure bufData
+    else flip BufData totalByteCount <$> allocateBuf totalByteCount
+  withForeignPtr (bufPtr bufData') $ \ptr -> do
+    runMarshalFastM (traverse_ push fa) ptr
+    Internal.pushFacts relation ptr (fromIntegral objCount)
+  pure bufData'
+  where
+    objCount = length fa
+    totalByteCount = case estimateNumBytes (Proxy @a) of
+      Exact numBytes -> numBytes * objCount
+      Estimated _ -> exactNumBytes fa
 {-# INLINABLE writeBytes #-}
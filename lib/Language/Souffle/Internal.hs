@@ -11,6 +11,8 @@ module Language.Souffle.Internal
   ( Souffle
   , Relation
   , ByteBuf
+  , Pipeline
+  , Snapshot
   , init
   , setNumThreads
   , getNumThreads
@@ -19,8 +21,24 @@ module Language.Souffle.Internal
   , printAll
   , getRelation
   , pushFacts
+  , withPipeline
+  , pushFactsPipelined
+  , waitForPipeline
   , popFacts
+  , popFactsCached
+  , clearSymbolCache
+  , popFactsRange
+  , popFactsSample
+  , popFactsChunked
+  , diffFacts
+  , snapshotRelation
+  , diffFactsSince
   , containsFact
+  , getRelationSize
+  , popFactsInto
+  , getRelationLayout
+  , useBloomFilter
+  , freezeRelation
   ) where
 
 import Prelude hiding ( init )
@@ -29,11 +47,13 @@ import Data.Word
 import Foreign.C.String
 import Foreign.C.Types
 import Foreign.ForeignPtr
+import Foreign.Marshal.Alloc
 import Foreign.Ptr
 import qualified Language.Souffle.Internal.Bindings as Bindings
 import Language.Souffle.Internal.Bindings
-  ( Souffle, Relation, ByteBuf )
-import Control.Exception (mask_)
+  ( Souffle, Relation, ByteBuf, Pipeline, Snapshot )
+import Control.Exception (bracket, mask_)
+import Control.Monad (when)
 
 
 {- | Initializes a Souffle program.
@@ -104,6 +124,46 @@ pushFacts relation buf x =
   Bindings.pushByteBuf relation buf (CSize x)
 {-# INLINABLE pushFacts #-}
 
+{-| Runs an action with a pipeline, which inserts facts into a relation on a
+    separate worker thread. All facts pushed to the pipeline are inserted
+    by the time this function returns, also when the action throws an
+    exception.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+withPipeline :: Ptr Relation -> (Ptr Pipeline -> IO a) -> IO a
+withPipeline relation =
+  bracket (Bindings.pipelineStart relation) Bindings.pipelineFinish
+{-# INLINABLE withPipeline #-}
+
+{-| Queues many serialized facts for insertion by a pipeline. This returns
+    immediately, the byte buffer needs to stay alive until the facts are
+    inserted (see 'waitForPipeline').
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+    Passing in a different count of objects to what is actually inside the
+    byte buffer will crash.
+-}
+pushFactsPipelined :: Ptr Pipeline -> Ptr ByteBuf -> Word64 -> IO ()
+pushFactsPipelined pipeline buf x =
+  Bindings.pipelinePush pipeline buf (CSize x)
+{-# INLINABLE pushFactsPipelined #-}
+
+{-| Waits until at least the given amount of byte buffers pushed to a
+    pipeline are inserted. This only blocks if they are not inserted yet.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+waitForPipeline :: Ptr Pipeline -> Word64 -> IO ()
+waitForPipeline pipeline count = do
+  CSize completed <- Bindings.pipelineCompleted pipeline
+  when (completed < count) $
+    Bindings.pipelineWait pipeline (CSize count)
+{-# INLINABLE waitForPipeline #-}
+
 {-| Serializes many facts from Haskell to Datalog.
 
     You need to check if the passed pointer is non-NULL before passing it
@@ -115,6 +175,90 @@ popFacts :: Ptr Souffle -> Ptr Relation -> IO (Ptr ByteBuf)
 popFacts = Bindings.popByteBuf
 {-# INLINABLE popFacts #-}
 
+{- | Pops all facts from a relation, using the symbol cache of the program.
+
+     Symbols that were already returned by a previous call to this function
+     are only returned as a symbol id, without the corresponding string.
+     Returns a pointer to a byte buffer, containing the serialized facts.
+-}
+popFactsCached :: Ptr Souffle -> Ptr Relation -> IO (Ptr ByteBuf)
+popFactsCached = Bindings.popByteBufCached
+{-# INLINABLE popFactsCached #-}
+
+-- | Forgets which symbols were returned by 'popFactsCached', so all symbols
+--   are returned with their corresponding string again afterwards.
+clearSymbolCache :: Ptr Souffle -> IO ()
+clearSymbolCache = Bindings.clearSymbolCache
+{-# INLINABLE clearSymbolCache #-}
+
+{- | Pops part of the facts of a relation: at most "limit" facts, starting
+     at the given offset. The facts are serialized like in 'popFacts'.
+
+     You need to check if the passed pointers are non-NULL before passing it
+     to this function. Not doing so results in undefined behavior.
+-}
+popFactsRange :: Ptr Souffle -> Ptr Relation -> Word64 -> Word64 -> IO (Ptr ByteBuf)
+popFactsRange prog relation offset limit =
+  Bindings.popByteBufRange prog relation (CSize offset) (CSize limit)
+{-# INLINABLE popFactsRange #-}
+
+{- | Pops a uniform random sample of distinct facts of a relation, using the
+     given seed. The facts are serialized like in 'popFacts'.
+
+     You need to check if the passed pointers are non-NULL before passing it
+     to this function. Not doing so results in undefined behavior.
+-}
+popFactsSample :: Ptr Souffle -> Ptr Relation -> Word64 -> Word64 -> IO (Ptr ByteBuf)
+popFactsSample prog relation count =
+  Bindings.popByteBufSample prog relation (CSize count)
+{-# INLINABLE popFactsSample #-}
+
+{- | Pops all facts of a relation like 'popFacts', split into the given
+     amount of chunks. The byte offset where each chunk starts is written
+     to the passed in array, so the chunks can be deserialized independently.
+
+     You need to check if the passed pointers are non-NULL before passing it
+     to this function. Not doing so results in undefined behavior.
+-}
+popFactsChunked :: Ptr Souffle -> Ptr Relation -> Word64 -> Ptr Word32 -> IO (Ptr ByteBuf)
+popFactsChunked prog relation chunkCount =
+  Bindings.popByteBufChunked prog relation (CSize chunkCount)
+{-# INLINABLE popFactsChunked #-}
+
+{- | Computes the difference between two relations with the same signature.
+     The returned buffer contains the facts only found in the first relation,
+     followed by the facts only found in the second relation. It is owned by
+     the program that is passed in.
+
+     You need to check if the passed pointers are non-NULL before passing it
+     to this function. Not doing so results in undefined behavior.
+-}
+diffFacts :: Ptr Souffle -> Ptr Relation -> Ptr Relation -> IO (Ptr ByteBuf)
+diffFacts = Bindings.relationDiff
+{-# INLINABLE diffFacts #-}
+
+{- | Creates a snapshot of all facts that are currently in a relation. The
+     snapshot is not affected by running the program again, so it can be
+     compared with a later state of the relation using 'diffFactsSince'.
+     It is freed automatically, but can only be used as long as the program
+     it was created from is alive.
+-}
+snapshotRelation :: Ptr Relation -> IO (ForeignPtr Snapshot)
+snapshotRelation relation = mask_ $ do
+  ptr <- Bindings.relationSnapshot relation
+  newForeignPtr Bindings.freeSnapshot ptr
+{-# INLINABLE snapshotRelation #-}
+
+{- | Computes the difference between a snapshot and a relation. The returned
+     buffer contains the facts only found in the snapshot, followed by the
+     facts only found in the relation. It is owned by the program that is
+     passed in.
+-}
+diffFactsSince :: Ptr Souffle -> ForeignPtr Snapshot -> Ptr Relation -> IO (Ptr ByteBuf)
+diffFactsSince prog snapshot relation =
+  withForeignPtr snapshot $ \ptr -> Bindings.snapshotDiff prog ptr relation
+{-# INLINABLE diffFactsSince #-}
+
 {- | Checks if a relation contains a certain tuple.
 
      Returns True if the tuple was found in the relation; otherwise False.
@@ -126,3 +270,61 @@ containsFact relation buf =
     CBool _ -> True
 {-# INLINABLE containsFact #-}
 
+-- | Returns the number of facts that are currently stored in a relation.
+getRelationSize :: Ptr Relation -> IO Word64
+getRelationSize relation = do
+  (CSize size) <- Bindings.relationSize relation
+  pure size
+{-# INLINABLE getRelationSize #-}
+
+{-| Copies facts that contain no symbols from Datalog directly into a byte
+    buffer that is owned by Haskell.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+    The buffer needs to be large enough to contain the requested amount of facts.
+
+    Returns the number of facts that were written into the buffer.
+-}
+popFactsInto :: Ptr Relation -> Ptr ByteBuf -> Word64 -> IO Word64
+popFactsInto relation buf maxCount = do
+  (CSize count) <- Bindings.popByteBufInto relation buf (CSize maxCount)
+  pure count
+{-# INLINABLE popFactsInto #-}
+
+{-| Returns the layout of the facts of a relation, as described by Souffle.
+
+    The result contains one character per field of the relation
+    ('i' for numbers, 'u' for unsigned numbers, 'f' for floats and 's' for
+    symbols).
+-}
+getRelationLayout :: Ptr Relation -> IO String
+getRelationLayout relation = do
+  arity <- Bindings.relationLayout relation nullPtr 0
+  let byteCount = fromIntegral arity
+  allocaBytes byteCount $ \ptr -> do
+    _ <- Bindings.relationLayout relation ptr arity
+    peekCAStringLen (ptr, byteCount)
+{-# INLINABLE getRelationLayout #-}
+
+{-| Enables or disables a Bloom filter for a relation, used to speed up
+    checking if a fact is /not/ part of the relation.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+useBloomFilter :: Ptr Relation -> Bool -> IO ()
+useBloomFilter relation enable =
+  Bindings.relationUseBloomFilter relation (if enable then 1 else 0)
+{-# INLINABLE useBloomFilter #-}
+
+{-| Freezes a relation into a read-only snapshot, which speeds up
+    serializing facts from Datalog and checking if a fact is part of the
+    relation. The snapshot is discarded again as soon as the relation changes.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+freezeRelation :: Ptr Relation -> IO ()
+freezeRelation = Bindings.relationFreeze
+{-# INLINABLE freezeRelation #-}
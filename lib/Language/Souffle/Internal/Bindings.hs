@@ -6,6 +6,8 @@ module Language.Souffle.Internal.Bindings
   ( Souffle
   , Relation
   , ByteBuf
+  , Pipeline
+  , Snapshot
   , init
   , free
   , setNumThreads
@@ -15,12 +17,32 @@ module Language.Souffle.Internal.Bindings
   , printAll
   , getRelation
   , pushByteBuf
+  , pipelineStart
+  , pipelinePush
+  , pipelineCompleted
+  , pipelineWait
+  , pipelineFinish
   , popByteBuf
+  , popByteBufCached
+  , clearSymbolCache
+  , popByteBufRange
+  , popByteBufSample
+  , popByteBufChunked
+  , relationDiff
+  , relationSnapshot
+  , freeSnapshot
+  , snapshotDiff
   , containsTuple
+  , relationSize
+  , popByteBufInto
+  , relationLayout
+  , relationUseBloomFilter
+  , relationFreeze
   ) where
 
 import Prelude hiding ( init )
 import Data.Kind (Type)
+import Data.Word
 import Foreign.C.String
 import Foreign.C.Types
 import Foreign.Ptr
@@ -39,6 +61,16 @@ data Relation
 type ByteBuf :: Type
 data ByteBuf
 
+-- | A void type, used for tagging a pointer that points to a pipeline for
+--   inserting facts.
+type Pipeline :: Type
+data Pipeline
+
+-- | A void type, used for tagging a pointer that points to a snapshot of
+--   the facts of a relation.
+type Snapshot :: Type
+data Snapshot
+
 
 {- | Initializes a Souffle program.
 
@@ -78,11 +110,13 @@ foreign import ccall unsafe "souffle_get_num_threads" getNumThreads
   :: Ptr Souffle -> IO CSize
 
 {-| Runs the Souffle program.
+    This is a safe call, so other Haskell threads (and other programs) can
+    keep running while the program is evaluated.
 
     You need to check if the pointer is equal to 'nullPtr' before passing
     it to this function. Not doing so results in undefined behavior (in C++).
 -}
-foreign import ccall unsafe "souffle_run" run
+foreign import ccall safe "souffle_run" run
   :: Ptr Souffle -> IO ()
 
 {-| Load all facts from files in a certain directory.
@@ -133,6 +167,54 @@ foreign import ccall unsafe "souffle_contains_tuple" containsTuple
 foreign import ccall unsafe "souffle_tuple_push_many" pushByteBuf
   :: Ptr Relation -> Ptr ByteBuf -> CSize -> IO ()
 
+{-| Starts a pipeline for inserting facts into a relation on a separate
+    worker thread.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+    No other operations on the program should be performed until the
+    pipeline is finished with 'pipelineFinish'.
+-}
+foreign import ccall unsafe "souffle_pipeline_start" pipelineStart
+  :: Ptr Relation -> IO (Ptr Pipeline)
+
+{-| Queues a byte buffer containing serialized facts for insertion.
+    This returns immediately, the byte buffer needs to stay alive until the
+    facts are inserted (see 'pipelineCompleted' and 'pipelineWait').
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall unsafe "souffle_pipeline_push" pipelinePush
+  :: Ptr Pipeline -> Ptr ByteBuf -> CSize -> IO ()
+
+{-| Returns how many byte buffers were inserted by the pipeline already.
+    This function does not block.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall unsafe "souffle_pipeline_completed" pipelineCompleted
+  :: Ptr Pipeline -> IO CSize
+
+{-| Blocks until at least the given amount of byte buffers were inserted.
+    This is a safe call, so other Haskell threads can keep running.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall safe "souffle_pipeline_wait" pipelineWait
+  :: Ptr Pipeline -> CSize -> IO ()
+
+{-| Waits until all byte buffers are inserted, and frees the pipeline.
+    This is a safe call, so other Haskell threads can keep running.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall safe "souffle_pipeline_finish" pipelineFinish
+  :: Ptr Pipeline -> IO ()
+
 {-| Serializes many Datalog facts from Datalog to Haskell
 
     You need to check if the passed pointers are non-NULL before passing it
@@ -143,3 +225,175 @@ foreign import ccall unsafe "souffle_tuple_push_many" pushByteBuf
 foreign import ccall unsafe "souffle_tuple_pop_many" popByteBuf
   :: Ptr Souffle -> Ptr Relation -> IO (Ptr ByteBuf)
 
+{-| Serializes many Datalog facts from Datalog to Haskell, using a symbol cache.
+
+    Each symbol is serialized as a tag containing the symbol id (shifted 1 bit
+    to the left) and a flag in the lowest bit. The flag is only set the first
+    time a symbol is sent for a program, in that case the tag is followed by
+    the serialized string.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+
+    Returns a pointer to a byte buffer that contains the serialized Datalog facts.
+-}
+foreign import ccall unsafe "souffle_tuple_pop_many_cached" popByteBufCached
+  :: Ptr Souffle -> Ptr Relation -> IO (Ptr ByteBuf)
+
+{-| Forgets which symbols were already sent by 'popByteBufCached', so all
+    symbols are sent again (including their strings) afterwards.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall unsafe "souffle_clear_symbol_cache" clearSymbolCache
+  :: Ptr Souffle -> IO ()
+
+{-| Serializes part of the Datalog facts of a relation from Datalog to Haskell,
+    starting at the given offset and containing at most the given amount of
+    facts. This is a safe call, since a relation that isn't frozen is
+    scanned up to the last requested fact.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+
+    Returns a pointer to a byte buffer that contains the serialized Datalog facts.
+-}
+foreign import ccall safe "souffle_tuple_pop_range" popByteBufRange
+  :: Ptr Souffle -> Ptr Relation -> CSize -> CSize -> IO (Ptr ByteBuf)
+
+{-| Serializes a uniform random sample of (distinct) Datalog facts of a
+    relation from Datalog to Haskell. This is a safe call, since a relation
+    that isn't frozen is scanned once.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+
+    Returns a pointer to a byte buffer that contains the serialized Datalog facts.
+-}
+foreign import ccall safe "souffle_tuple_sample" popByteBufSample
+  :: Ptr Souffle -> Ptr Relation -> CSize -> Word64 -> IO (Ptr ByteBuf)
+
+{-| Serializes many Datalog facts from Datalog to Haskell, like 'popByteBuf',
+    and writes the byte offset where each chunk of facts starts to the
+    passed in array (which needs room for one offset per chunk).
+    Every chunk contains the same amount of facts (rounded up), except for
+    the last one.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+
+    Returns a pointer to a byte buffer that contains the serialized Datalog facts.
+-}
+foreign import ccall unsafe "souffle_tuple_pop_chunked" popByteBufChunked
+  :: Ptr Souffle -> Ptr Relation -> CSize -> Ptr Word32 -> IO (Ptr ByteBuf)
+
+{-| Computes the difference between two relations with the same signature,
+    which can belong to different programs. The byte buffer contains the
+    facts only found in the first relation, followed by the facts only found
+    in the second relation. Relations that aren't frozen are copied for the
+    duration of the call.
+    This is a safe call, since it can take a while for large relations.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+
+    Returns a pointer to a byte buffer that contains the serialized Datalog facts.
+-}
+foreign import ccall safe "souffle_relation_diff" relationDiff
+  :: Ptr Souffle -> Ptr Relation -> Ptr Relation -> IO (Ptr ByteBuf)
+
+{-| Creates a snapshot of all facts that are currently in a relation, which
+    is not affected by later changes to the relation (for example by running
+    the program again). The snapshot needs to be freed with 'freeSnapshot',
+    and can only be diffed against the program it was created from.
+    This is a safe call, since it copies all facts of the relation.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall safe "souffle_relation_snapshot" relationSnapshot
+  :: Ptr Relation -> IO (Ptr Snapshot)
+
+{-| Frees the memory in use by a snapshot, previously allocated by
+    'relationSnapshot'.
+-}
+foreign import ccall unsafe "&souffle_snapshot_free" freeSnapshot
+  :: FunPtr (Ptr Snapshot -> IO ())
+
+{-| Computes the difference between a snapshot and a relation with the same
+    signature, like 'relationDiff'. The byte buffer contains the facts only
+    found in the snapshot, followed by the facts only found in the relation.
+    This is a safe call, since it can take a while for large relations.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+
+    Returns a pointer to a byte buffer that contains the serialized Datalog facts.
+-}
+foreign import ccall safe "souffle_snapshot_diff" snapshotDiff
+  :: Ptr Souffle -> Ptr Snapshot -> Ptr Relation -> IO (Ptr ByteBuf)
+
+{-| Returns the number of facts that are currently stored in a relation.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall unsafe "souffle_relation_size" relationSize
+  :: Ptr Relation -> IO CSize
+
+{-| Copies Datalog facts directly into a byte buffer owned by Haskell.
+
+    The facts are written as a packed array of 4-byte values (without a leading
+    fact count). This only works for relations that contain no symbols, and the
+    buffer needs to be large enough to contain the requested amount of facts.
+
+    You need to check if the passed pointers are non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+
+    Returns the number of facts that were written into the buffer.
+-}
+foreign import ccall unsafe "souffle_tuple_pop_into" popByteBufInto
+  :: Ptr Relation -> Ptr ByteBuf -> CSize -> IO CSize
+
+{-| Describes the layout of the facts of a relation.
+
+    One character is written to the passed in buffer for each field of the
+    relation ('i' for numbers, 'u' for unsigned numbers, 'f' for floats and
+    's' for symbols), up to the given capacity. The buffer is allowed to be
+    'nullPtr' if the capacity is 0.
+
+    You need to check if the passed relation pointer is non-NULL before passing
+    it to this function. Not doing so results in undefined behavior.
+
+    Returns the arity of the relation.
+-}
+foreign import ccall unsafe "souffle_relation_layout" relationLayout
+  :: Ptr Relation -> CString -> CSize -> IO CSize
+
+{-| Enables or disables a Bloom filter for a relation.
+
+    The filter is used by 'containsTuple' to quickly reject facts that are not
+    part of the relation. It is built lazily on the next lookup and rebuilt
+    after running the program or loading facts from disk.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall unsafe "souffle_relation_use_bloom_filter" relationUseBloomFilter
+  :: Ptr Relation -> CBool -> IO ()
+
+{-| Freezes a relation into a read-only snapshot.
+
+    All following pops and lookups of the relation use the snapshot, which
+    stores all facts in a compact array (with a cache-friendly search layout).
+    The snapshot is discarded when facts are pushed to the relation, or when
+    the program is run or loads facts from disk.
+    This is a safe call, since building the snapshot sorts all facts and
+    would otherwise block all other Haskell threads.
+
+    You need to check if the passed pointer is non-NULL before passing it
+    to this function. Not doing so results in undefined behavior.
+-}
+foreign import ccall safe "souffle_relation_freeze" relationFreeze
+  :: Ptr Relation -> IO ()
@@ -0,0 +1,43 @@
+{-# LANGUAGE TypeApplications #-}
+
+-- | An internal module, containing helper functions for running actions
+--   concurrently that are shared by the compiled and interpreted backends.
+--
+--   Used only internally, so prone to changes, use at your own risk.
+module Language.Souffle.Internal.Concurrent
+  ( concurrently
+  , concurrently_
+  ) where
+
+import Control.Concurrent
+import Control.Exception ( SomeException, mask, onException, throwIO, try
+                         , uninterruptibleMask_ )
+import Control.Monad ( void )
+import Data.Foldable ( traverse_ )
+import Data.Traversable ( for )
+
+-- | Runs the actions concurrently, spread over the available capabilities,
+--   and waits for all of them to finish. If an action throws an exception,
+--   it is rethrown in the calling thread, after all other actions finished.
+--   If the calling thread is interrupted, all actions are cancelled and
+--   awaited first. Actions often use shared resources (a buffer, or a
+--   temporary directory), so none of them may outlive this call.
+concurrently :: [IO b] -> IO [b]
+concurrently actions = mask $ \restore -> do
+  workers <- for (zip [0..] actions) $ \(capability, action) -> do
+    var <- newEmptyMVar
+    threadId <- forkOnWithUnmask capability $ \unmask ->
+      putMVar var =<< try @SomeException (unmask action)
+    pure (threadId, var)
+  let waitForAll = for workers (readMVar . snd)
+      cancelAll = uninterruptibleMask_ $ do
+        traverse_ (killThread . fst) workers
+        void waitForAll
+  results <- restore waitForAll `onException` cancelAll
+  traverse (either throwIO pure) results
+{-# INLINABLE concurrently #-}
+
+-- | Same as 'concurrently', but discards the results.
+concurrently_ :: [IO b] -> IO ()
+concurrently_ = void . concurrently
+{-# INLINABLE concurrently_ #-}
@@ -28,32 +28,49 @@ module Language.Souffle.Interpreted
   , defaultConfig
   , souffleStdOut
   , souffleStdErr
+  , replaceFacts
+  , clearFacts
+  , runConcurrently
+  , UnsupportedSymbol(..)
   ) where
 
 import Prelude hiding (init)
 import Data.Kind (Type, Constraint)
 
-import Control.DeepSeq (deepseq)
-import Control.Exception (ErrorCall(..), throwIO, bracket)
+import Control.Concurrent
+import Control.Exception (ErrorCall(..), Exception, SomeException, throwIO, bracket,
+                          bracket_, evaluate, finally, try)
 import Control.Monad.State.Strict
+import Data.Bits (xor)
+import Data.Char (isDigit)
 import Data.IORef
-import Data.Foldable (traverse_)
-import qualified Data.List as List hiding (init)
+import Data.Foldable (toList, traverse_)
 import Data.Semigroup (Last(..))
-import Data.Maybe (fromMaybe)
+import Data.Maybe (fromMaybe, mapMaybe)
 import Data.Proxy
 import qualified Data.Array as A
+import qualified Data.ByteString as BS
+import qualified Data.ByteString.Char8 as BS8
+import qualified Data.ByteString.Builder as BSB
+import qualified Data.ByteString.Lazy as BSL
+import qualified Data.Map.Strict as Map
+import qualified Data.Set as Set
 import qualified Data.Text as T
+import qualified Data.Text.Encoding as TE
 import qualified Data.Vector as V
 import Data.Word
 import Language.Souffle.Class
+import Language.Souffle.Internal.Concurrent ( concurrently_ )
 import Language.Souffle.Marshal
 import System.Directory
 import System.Environment
 import System.Exit
 import System.FilePath
-import System.IO (hGetContents, hClose)
+import System.IO (hGetContents, hClose, hSetBuffering, openBinaryFile,
+                  withBinaryFile, BufferMode(..), IOMode(..))
+import System.IO.Error (isDoesNotExistError)
 import System.IO.Temp
+import System.Posix.Files (createNamedPipe, ownerReadMode, ownerWriteMode, unionFileModes)
 import System.Process
 import Text.Printf
 
@@ -76,6 +93,16 @@ newtype SouffleM a = SouffleM (IO a)
 --   souffle session.
 --   - __cfgOutputDir__: The directory where the output fact file(s) are created.
 --   If Nothing, it will be part of the temporary directory.
+--   - __cfgCompileCache__: The directory where compiled versions of datalog
+--   programs are cached. If set, the program is compiled once (using
+--   @souffle -o@) and the resulting executable is used instead of the
+--   interpreter. The cached executable is keyed by a hash of the main datalog
+--   file and the souffle version, files included by the program are not
+--   taken into account. If Nothing, the interpreter is used.
+--   - __cfgStreamFacts__: If True, facts added using 'addFact' or 'addFacts' are
+--   kept in memory and streamed to souffle through named pipes during 'run',
+--   instead of being written to the fact directory. Output facts are still
+--   read from files in the output directory.
 type Config :: Type
 data Config
   = Config
@@ -83,6 +110,8 @@ data Config
   , cfgSouffleBin   :: Maybe FilePath
   , cfgFactDir      :: Maybe FilePath
   , cfgOutputDir    :: Maybe FilePath
+  , cfgCompileCache :: Maybe FilePath
+  , cfgStreamFacts  :: Bool
   } deriving stock Show
 
 -- | Retrieves the default config for the interpreter. These settings can
@@ -97,13 +126,15 @@ data Config
 --   if the variable is not set.
 --   - __cfgFactDir__: Will make use of a temporary directory.
 --   - __cfgOutputDir__: Will make use of a temporary directory.
+--   - __cfgCompileCache__: Disabled, the interpreter is used.
+--   - __cfgStreamFacts__: False, facts are written to files.
 defaultConfig :: MonadIO m => m Config
 defaultConfig = liftIO $ do
   dlDir <- lookupEnv "DATALOG_DIR"
   envSouffleBin <- fmap Last <$> lookupEnv "SOUFFLE_BIN"
   locatedBin <- fmap Last <$> locateSouffle
   let souffleBin = getLast <$> locatedBin <> envSouffleBin
-  pure $ Config (fromMaybe "." dlDir) souffleBin Nothing Nothing
+  pure $ Config (fromMaybe "." dlDir) souffleBin Nothing Nothing Nothing False
 {-# INLINABLE defaultConfig #-}
 
 {- | Initializes and runs a Souffle program with default settings.
@@ -149,7 +180,9 @@ runSouffleWith cfg program f = bracket initialize maybeCleanup $ \handle -> do
         let factDir = fromMaybe (souffleTempDir </> "fact") $ cfgFactDir cfg
             outDir = fromMaybe (souffleTempDir </> "out") $ cfgOutputDir cfg
         traverse_ (createDirectoryIfMissing True) [factDir, outDir]
-        forM mSouffleBin $ \souffleBin ->
+        forM mSouffleBin $ \souffleBin -> do
+          compiledExecutable <- traverse (compileCached souffleBin datalogExecutable)
+                                         (cfgCompileCache cfg)
           Handle
             <$> (newIORef $ HandleData
                   { soufflePath = souffleBin
@@ -157,10 +190,15 @@ runSouffleWith cfg program f = bracket initialize maybeCleanup $ \handle -> do
                   , factPath    = factDir
                   , outputPath  = outDir
                   , datalogExec = datalogExecutable
+                  , compiledExec = compiledExecutable
+                  , streamFacts = cfgStreamFacts cfg
                   , noOfThreads = 1
                   })
             <*> newIORef Nothing
             <*> newIORef Nothing
+            <*> newIORef []
+            <*> newIORef Map.empty
+            <*> newIORef Map.empty
     maybeCleanup = maybe mempty $ \h -> do
       handle <- readIORef $ handleData h
       removeDirectoryRecursive $ tmpDirPath handle
@@ -175,9 +213,44 @@ data Handle prog = Handle
   { handleData   :: IORef HandleData
   , stdoutResult :: IORef (Maybe T.Text)
   , stderrResult :: IORef (Maybe T.Text)
+  , streamedFacts :: IORef [(FilePath, BSB.Builder)]
+    -- ^ Facts per fact file, only used if facts are streamed to souffle.
+  , outputCache  :: IORef (Map.Map String CachedOutput)
+    -- ^ Output facts per relation, cleared on every run.
+  , inputHashes  :: IORef (Map.Map String Word64)
+    -- ^ Hashes of the input facts per relation, set by 'replaceFacts'.
   }
 type role Handle nominal
 
+-- | The output facts of a relation, cached until the next 'run'.
+type CachedOutput :: Type
+data CachedOutput
+  = CachedOutput
+  { cachedContents :: !BS.ByteString
+    -- ^ The contents of the .csv file.
+  , cachedIndex :: !(Maybe (Set.Set BS.ByteString))
+    -- ^ All facts, serialized in the same way as input facts.
+    --   Only created when 'findFact' is used.
+  }
+
+-- | Looks up the output facts of a relation. The .csv file is only read
+--   the first time the facts are needed after a 'run'.
+lookupOutput :: Handle prog -> String -> IO CachedOutput
+lookupOutput h relationName = do
+  cache <- readIORef $ outputCache h
+  case Map.lookup relationName cache of
+    Just output -> pure output
+    Nothing -> do
+      handle <- readIORef $ handleData h
+      let outputFile = outputPath handle </> relationName <.> "csv"
+      contents <- doesFileExist outputFile >>= \case
+        False -> pure BS.empty
+        True -> BS.readFile outputFile
+      let output = CachedOutput contents Nothing
+      modifyIORef' (outputCache h) $ Map.insert relationName output
+      pure output
+{-# INLINABLE lookupOutput #-}
+
 -- | The data needed for the interpreter is the path where the souffle
 --   executable can be found, and a template directory where the program
 --   is stored.
@@ -188,84 +261,335 @@ data HandleData = HandleData
   , factPath    :: FilePath
   , outputPath  :: FilePath
   , datalogExec :: FilePath
+  , compiledExec :: Maybe FilePath
+  , streamFacts :: Bool
   , noOfThreads :: Word64
   }
 
-type IMarshal :: Type -> Type
-newtype IMarshal a = IMarshal (State [String] a)
-  deriving (Functor, Applicative, Monad, MonadState [String])
-  via (State [String])
-
-instance MonadPush IMarshal where
-  pushInt32 int = modify (show int:)
+-- | Exception that is thrown when facts are added that contain a symbol
+--   with a tab or a newline. Souffle reads facts line by line and splits
+--   them on tabs, and there is no way to escape these characters.
+type UnsupportedSymbol :: Type
+newtype UnsupportedSymbol = UnsupportedSymbol T.Text
+  deriving stock (Eq, Show)
+
+instance Exception UnsupportedSymbol
+
+-- | The fields of a single fact that is being serialized, separated by tabs.
+--   Once an unsupported symbol is found, the remaining fields are ignored.
+type FactLine :: Type
+data FactLine
+  = NoFields
+  | Fields !BSB.Builder
+  | Unsupported !T.Text
+
+-- | A monad used solely for serializing facts to a .facts file, in the
+--   format expected by Souffle (one fact per line, fields separated by tabs).
+type IMarshalPush :: Type -> Type
+newtype IMarshalPush a = IMarshalPush (State FactLine a)
+  deriving (Functor, Applicative, Monad, MonadState FactLine)
+  via (State FactLine)
+
+pushField :: BSB.Builder -> IMarshalPush ()
+pushField field = modify' $ \case
+  NoFields -> Fields field
+  Fields fields -> Fields $ fields <> BSB.char7 '\t' <> field
+  Unsupported txt -> Unsupported txt
+{-# INLINABLE pushField #-}
+
+instance MonadPush IMarshalPush where
+  pushInt32 = pushField . BSB.int32Dec
   {-# INLINABLE pushInt32 #-}
 
-  pushUInt32 int = modify (show int:)
+  pushUInt32 = pushField . BSB.word32Dec
   {-# INLINABLE pushUInt32 #-}
 
-  pushFloat float = modify (show float:)
+  pushFloat = pushField . BSB.floatDec
   {-# INLINABLE pushFloat #-}
 
-  pushString str = modify (str:)
+  pushString = pushText . T.pack
   {-# INLINABLE pushString #-}
 
-  pushText txt = pushString (T.unpack txt)
+  pushText txt
+    | T.any (\c -> c == '\t' || c == '\n') txt = put $ Unsupported txt
+    | otherwise = pushField $ TE.encodeUtf8Builder txt
   {-# INLINABLE pushText #-}
 
+-- | Serializes a single fact as a line in a .facts file.
+factLine :: Marshal a => a -> Either UnsupportedSymbol BSB.Builder
+factLine fact =
+  let (IMarshalPush m) = push fact
+   in case execState m NoFields of
+        NoFields -> Right $ BSB.char7 '\n'
+        Fields fields -> Right $ fields <> BSB.char7 '\n'
+        Unsupported txt -> Left $ UnsupportedSymbol txt
+{-# INLINABLE factLine #-}
+
+-- | Serializes facts as lines in a .facts file. All facts are checked
+--   before anything is written, so an unsupported symbol never leaves a
+--   partially written .facts file behind.
+factLines :: (Marshal a, Foldable f) => f a -> IO BSB.Builder
+factLines facts =
+  either throwIO (pure . mconcat) $ traverse factLine $ toList facts
+{-# INLINABLE factLines #-}
+
+-- | Serializes a single fact, in the same way as it is written to a .facts file.
+--   Returns 'Nothing' for facts that can't be written to a .facts file.
+serializeFact :: Marshal a => a -> Maybe BS.ByteString
+serializeFact =
+  either (const Nothing) (Just . BSL.toStrict . BSB.toLazyByteString) . factLine
+{-# INLINABLE serializeFact #-}
+
+-- | Appends facts to a .facts file, using a single buffered handle.
+appendFacts :: FilePath -> BSB.Builder -> IO ()
+appendFacts factFile builder =
+  withBinaryFile factFile AppendMode $ \h -> do
+    hSetBuffering h $ BlockBuffering $ Just factBufferSize
+    BSB.hPutBuilder h builder
+
+factBufferSize :: Int
+factBufferSize = 64 * 1024
+
+-- | Adds facts to a relation. Depending on the configuration, the facts are
+--   appended to the .facts file of the relation, or kept in memory until
+--   they are streamed to souffle.
+writeFacts :: (Marshal a, Foldable f) => Handle prog -> String -> f a -> IO ()
+writeFacts h relationName facts = do
+  handle <- readIORef $ handleData h
+  builder <- factLines facts
+  let factFile = relationName <.> "facts"
+  modifyIORef' (inputHashes h) $ Map.delete relationName
+  if streamFacts handle
+    then modifyIORef' (streamedFacts h) $
+      updateStreamed factFile (<> builder)
+    else appendFacts (factPath handle </> factFile) builder
+{-# INLINABLE writeFacts #-}
+
+updateStreamed :: FilePath -> (BSB.Builder -> BSB.Builder)
+               -> [(FilePath, BSB.Builder)] -> [(FilePath, BSB.Builder)]
+updateStreamed factFile f = \case
+  [] -> [(factFile, f mempty)]
+  (file, builder) : rest
+    | file == factFile -> (file, f builder) : rest
+    | otherwise -> (file, builder) : updateStreamed factFile f rest
+{-# INLINABLE updateStreamed #-}
+
+{- | Replaces all facts of a relation with the given facts.
+
+     Contrary to 'addFacts', the facts are not appended to the facts that
+     were added before. A hash of the facts is kept for each relation, so
+     nothing is rewritten if the facts did not change since the previous call
+     to this function. This makes it cheap to run a program repeatedly, while
+     only changing a few relations between runs.
+
+     Note that this also replaces the initial facts present in the fact
+     directory, unless facts are streamed to souffle (see 'cfgStreamFacts').
+-}
+replaceFacts :: forall a prog f. (Fact a, ContainsInputFact prog a, Foldable f)
+             => Handle prog -> f a -> SouffleM ()
+replaceFacts h facts = liftIO $ do
+  handle <- readIORef $ handleData h
+  hashes <- readIORef $ inputHashes h
+  contents <- BSB.toLazyByteString <$> factLines facts
+  let relationName = factName (Proxy :: Proxy a)
+      factFile = relationName <.> "facts"
+      hash = fnv1a contents
+  unless (Map.lookup relationName hashes == Just hash) $ do
+    if streamFacts handle
+      then modifyIORef' (streamedFacts h) $
+        updateStreamed factFile (const $ BSB.lazyByteString contents)
+      else BSL.writeFile (factPath handle </> factFile) contents
+    modifyIORef' (inputHashes h) $ Map.insert relationName hash
+{-# INLINABLE replaceFacts #-}
+
+-- | Removes all facts of a relation, see also 'replaceFacts'.
+clearFacts :: forall a prog. (Fact a, ContainsInputFact prog a)
+           => Handle prog -> Proxy a -> SouffleM ()
+clearFacts h _ = replaceFacts h ([] :: [a])
+{-# INLINABLE clearFacts #-}
+
+{- | Runs the actions concurrently and waits for all of them to finish.
+     If an action throws an exception, it is rethrown in the calling thread,
+     after all other actions finished. If the calling thread is interrupted,
+     all actions are cancelled and awaited first.
+
+     This can be passed to 'Language.Souffle.Analysis.execAnalysisConcurrently'
+     to run independent analyses at the same time. Each action should use a
+     separate program handle.
+-}
+runConcurrently :: [SouffleM ()] -> SouffleM ()
+runConcurrently actions =
+  SouffleM $ concurrently_ $ map (\(SouffleM action) -> action) actions
+{-# INLINABLE runConcurrently #-}
+
+{- | Prepares the directory containing the input facts for souffle.
+
+     If facts are not streamed, this is the configured fact directory.
+     Otherwise a separate directory is created containing a named pipe for
+     each relation with streamed facts, and links to all other files in the
+     fact directory. The facts are written to the pipes concurrently, while
+     souffle reads them. Facts that are already present in the fact directory
+     for a streamed relation are sent first.
+-}
+withFactDir :: HandleData -> [(FilePath, BSB.Builder)] -> (FilePath -> IO a) -> IO a
+withFactDir handle streamed action
+  | not (streamFacts handle) || null streamed = action factDir
+  | otherwise = bracket_ createPipeDir (removeDirectoryRecursive pipeDir) $ do
+      writers <- forM streamed $ \(factFile, builder) -> do
+        done <- newEmptyMVar
+        _ <- forkIO $ putMVar done =<< try (writePipe factFile builder)
+        pure (pipeDir </> factFile, done)
+      result <- action pipeDir `finally` traverse_ (uncurry drainPipe) writers
+      traverse_ (either throwIO pure <=< readMVar . snd) writers
+      pure result
+  where
+    factDir = factPath handle
+    pipeDir = tmpDirPath handle </> "pipes"
+    pipeFiles = map fst streamed
+    createPipeDir = do
+      createDirectoryIfMissing True pipeDir
+      -- NOTE: link targets are resolved relative to the directory of the
+      -- link, so they need to be absolute.
+      absFactDir <- makeAbsolute factDir
+      factFiles <- listDirectory factDir
+      forM_ (filter (`notElem` pipeFiles) factFiles) $ \factFile ->
+        createFileLink (absFactDir </> factFile) (pipeDir </> factFile)
+      forM_ pipeFiles $ \pipeFile ->
+        createNamedPipe (pipeDir </> pipeFile) (ownerReadMode `unionFileModes` ownerWriteMode)
+    writePipe factFile builder =
+      bracket (openPipeWriter (pipeDir </> factFile)) hClose $ \h -> do
+        hSetBuffering h $ BlockBuffering $ Just factBufferSize
+        let initialFactFile = factDir </> factFile
+        hasInitialFacts <- doesFileExist initialFactFile
+        when hasInitialFacts $
+          BS.hPut h =<< BS.readFile initialFactFile
+        BSB.hPutBuilder h builder
+    -- NOTE: the pipe is opened write-only, so the facts are only written once
+    -- souffle (or drainPipe) has the other end open. If the pipe were closed
+    -- before that, Linux would discard the facts still buffered in the pipe.
+    -- A non-blocking open fails while there is no reader yet, so it is
+    -- retried. A blocking open would block the entire RTS when not using the
+    -- threaded runtime.
+    openPipeWriter pipe = try (openBinaryFile pipe WriteMode) >>= \case
+      Right h -> pure h
+      Left e
+        | isDoesNotExistError e -> threadDelay pipeRetryDelay *> openPipeWriter pipe
+        | otherwise -> throwIO e
+    -- If souffle did not read (all of) a pipe, the remaining facts are read
+    -- and discarded, so the writing thread can finish.
+    drainPipe :: FilePath -> MVar (Either SomeException ()) -> IO ()
+    drainPipe pipe done = tryReadMVar done >>= \case
+      Just _ -> pure ()
+      Nothing -> do
+        withBinaryFile pipe ReadMode $ void . BS.hGetContents
+        threadDelay pipeRetryDelay
+        drainPipe pipe done
+{-# INLINABLE withFactDir #-}
+
+-- | Delay (in microseconds) before opening a named pipe is tried again.
+pipeRetryDelay :: Int
+pipeRetryDelay = 1000
+
+-- | A monad used solely for deserializing a single line of a .csv file
+--   written by Souffle. The state contains the remaining part of the line.
+type IMarshal :: Type -> Type
+newtype IMarshal a = IMarshal (State BS.ByteString a)
+  deriving (Functor, Applicative, Monad, MonadState BS.ByteString)
+  via (State BS.ByteString)
+
+popField :: IMarshal BS.ByteString
+popField = state $ \line ->
+  let (field, rest) = BS8.break (== '\t') line
+   in (field, BS.drop 1 rest)
+{-# INLINABLE popField #-}
+
+popIntegral :: Num a => IMarshal a
+popIntegral = do
+  field <- popField
+  case BS8.readInt field of
+    Just (x, rest) | BS.null rest -> pure $ fromIntegral x
+    _ -> error $ "Failed to parse number: " <> show field
+{-# INLINABLE popIntegral #-}
+
+popFractional :: IMarshal Float
+popFractional = do
+  field <- popField
+  case readFloat field of
+    Just x -> pure x
+    Nothing -> error $ "Failed to parse number: " <> show field
+{-# INLINABLE popFractional #-}
+
+-- | Parses a float in the format written by Souffle (e.g. @-1.5@, @2e-07@ or
+--   @inf@), directly from the 'BS.ByteString'. The digits are collected into
+--   an integer mantissa and a decimal exponent. If both are small enough,
+--   they are exact as a 'Float' and the result is a single multiplication
+--   or division, otherwise the value is rounded via a 'Rational'.
+readFloat :: BS.ByteString -> Maybe Float
+readFloat field = case BS8.uncons field of
+  Just ('-', rest) -> negate <$> readUnsigned rest
+  Just ('+', rest) -> readUnsigned rest
+  _ -> readUnsigned field
+  where
+    readUnsigned bs
+      | bs == "inf" || bs == "Infinity" = Just $ 1 / 0
+      | bs == "nan" || bs == "NaN" = Just $ 0 / 0
+      | otherwise = do
+          let (intPart, afterInt) = BS8.span isDigit bs
+              (fracPart, afterFrac) = case BS8.uncons afterInt of
+                Just ('.', rest) -> BS8.span isDigit rest
+                _ -> (BS.empty, afterInt)
+          guard $ not (BS.null intPart && BS.null fracPart)
+          exponent <- case BS8.uncons afterFrac of
+            Nothing -> Just 0
+            Just (c, rest) | c == 'e' || c == 'E' -> case BS8.readInt rest of
+              Just (e, rest') | BS.null rest' -> Just e
+              _ -> Nothing
+            _ -> Nothing
+          let addDigit acc d = acc * 10 + toInteger (d - 48)
+              mantissa = BS.foldl' addDigit (BS.foldl' addDigit 0 intPart) fracPart
+              e = exponent - BS.length fracPart
+          pure $ if mantissa < 2 ^ (24 :: Int) && abs e <= 10
+            then if e >= 0
+              then fromInteger mantissa * 10 ^ e
+              else fromInteger mantissa / 10 ^ negate e
+            else fromRational $ fromInteger mantissa * 10 ^^ e
+{-# INLINABLE readFloat #-}
+
 instance MonadPop IMarshal where
-  popInt32 = state $ \case
-    [] -> error "Empty fact stack"
-    (h:t) -> (read h, t)
+  popInt32 = popIntegral
   {-# INLINABLE popInt32 #-}
 
-  popUInt32 = state $ \case
-    [] -> error "Empty fact stack"
-    (h:t) -> (read h, t)
+  popUInt32 = popIntegral
   {-# INLINABLE popUInt32 #-}
 
-  popFloat = state $ \case
-    [] -> error "Empty fact stack"
-    (h:t) -> (read h, t)
+  popFloat = popFractional
   {-# INLINABLE popFloat #-}
 
-  popString = state $ \case
-    [] -> error "Empty fact stack"
-    (h:t) -> (h, t)
+  popString = T.unpack <$> popText
   {-# INLINABLE popString #-}
 
-  popText = do
-    str <- state $ \case
-      [] -> error "Empty fact stack"
-      (h:t) -> (h, t)
-    pure $ T.pack str
+  popText = TE.decodeUtf8 <$> popField
   {-# INLINABLE popText #-}
 
-popMarshalT :: IMarshal a -> [String] -> a
+popMarshalT :: IMarshal a -> BS.ByteString -> a
 popMarshalT (IMarshal m) = evalState m
 {-# INLINABLE popMarshalT #-}
 
-pushMarshalT :: IMarshal a -> [String]
-pushMarshalT (IMarshal m) = reverse $ execState m []
-{-# INLINABLE pushMarshalT #-}
-
 type Collect :: (Type -> Type) -> Constraint
 class Collect c where
-  collect :: Marshal a => FilePath -> IO (c a)
+  collect :: Marshal a => BS.ByteString -> IO (c a)
 
 instance Collect [] where
-  collect factFile = do
-    factLines <- readCSVFile factFile
-    let facts = map (popMarshalT pop) factLines
-    pure $! facts
+  collect = parseCSV
   {-# INLINABLE collect #-}
 
 instance Collect V.Vector where
-  collect factFile = V.fromList <$!> collect factFile
+  collect contents = V.fromList <$!> collect contents
   {-# INLINABLE collect #-}
 
 instance Collect (A.Array Int) where
-  collect factFile = do
-    facts <- collect factFile
+  collect contents = do
+    facts <- collect contents
     let count = length facts
     pure $! A.listArray (0, count - 1) facts
   {-# INLINABLE collect #-}
@@ -275,39 +599,51 @@ instance MonadSouffle SouffleM where
   type CollectFacts SouffleM c = Collect c
   type SubmitFacts SouffleM _ = ()
 
-  run (Handle refHandleData refHandleStdOut refHandleStdErr) = liftIO $ do
+  run (Handle refHandleData refHandleStdOut refHandleStdErr refStreamedFacts refOutputCache _) = liftIO $ do
     handle <- readIORef refHandleData
-    -- Invoke the souffle binary using parameters, supposing that the facts
-    -- are placed in the factPath, rendering the output into the outputPath.
-    let processToRun =
-          (shell
-            (printf "%s -F%s -D%s -j%d %s"
-              (soufflePath handle)
-              (factPath handle)
-              (outputPath handle)
-              (noOfThreads handle)
-              (datalogExec handle)))
-            { std_in  = NoStream
-            , std_out = CreatePipe
-            , std_err = CreatePipe
-            }
-    bracket
-      (createProcess_ "souffle-haskell" processToRun)
-      (\(_, mStdOutHandle, mStdErrHandle, _) -> do
-        traverse_ hClose mStdOutHandle
-        traverse_ hClose mStdErrHandle
-      )
-      (\(_, mStdOutHandle, mStdErrHandle, processHandle) -> do
-        waitForProcess processHandle >>= \case
-          ExitSuccess   -> pure ()
-          ExitFailure c -> throwIO $ ErrorCall $ "Souffle exited with: " ++ show c
-        forM_ mStdOutHandle $ \stdoutHandle -> do
-          stdout <- T.pack <$!> hGetContents stdoutHandle
-          writeIORef refHandleStdOut $! Just $! stdout
-        forM_ mStdErrHandle $ \stderrHandle -> do
-          stderr <- T.pack <$!> hGetContents stderrHandle
-          writeIORef refHandleStdErr $! Just $! stderr
-      )
+    writeIORef refOutputCache Map.empty
+    streamed <- readIORef refStreamedFacts
+    withFactDir handle streamed $ \factDir -> do
+      -- Invoke the souffle binary (or the cached compiled program) using
+      -- parameters, supposing that the facts are placed in the factDir,
+      -- rendering the output into the outputPath.
+      let command = case compiledExec handle of
+            Nothing ->
+              printf "%s -F%s -D%s -j%d %s"
+                (soufflePath handle)
+                factDir
+                (outputPath handle)
+                (noOfThreads handle)
+                (datalogExec handle)
+            Just executable ->
+              printf "%s -F%s -D%s -j%d"
+                executable
+                factDir
+                (outputPath handle)
+                (noOfThreads handle)
+          processToRun =
+            (shell command)
+              { std_in  = NoStream
+              , std_out = CreatePipe
+              , std_err = CreatePipe
+              }
+      bracket
+        (createProcess_ "souffle-haskell" processToRun)
+        (\(_, mStdOutHandle, mStdErrHandle, _) -> do
+          traverse_ hClose mStdOutHandle
+          traverse_ hClose mStdErrHandle
+        )
+        (\(_, mStdOutHandle, mStdErrHandle, processHandle) -> do
+          waitForProcess processHandle >>= \case
+            ExitSuccess   -> pure ()
+            ExitFailure c -> throwIO $ ErrorCall $ "Souffle exited with: " ++ show c
+          forM_ mStdOutHandle $ \stdoutHandle -> do
+            stdout <- T.pack <$!> hGetContents stdoutHandle
+            writeIORef refHandleStdOut $! Just $! stdout
+          forM_ mStdErrHandle $ \stderrHandle -> do
+            stderr <- T.pack <$!> hGetContents stderrHandle
+            writeIORef refHandleStdErr $! Just $! stderr
+        )
   {-# INLINABLE run #-}
 
   setNumThreads handle n = liftIO $
@@ -321,38 +657,42 @@ instance MonadSouffle SouffleM where
   getFacts :: forall a c prog. (Marshal a, Fact a, ContainsOutputFact prog a, Collect c)
            => Handle prog -> SouffleM (c a)
   getFacts h = liftIO $ do
-    handle <- readIORef $ handleData h
     let relationName = factName (Proxy :: Proxy a)
-    let factFile = outputPath handle </> relationName <.> "csv"
-    facts <- collect factFile
-    pure $! facts  -- force facts before running to avoid issues with lazy IO
+    output <- lookupOutput h relationName
+    facts <- collect $ cachedContents output
+    pure $! facts
   {-# INLINABLE getFacts #-}
 
-  findFact :: (Fact a, ContainsOutputFact prog a, Eq a)
+  findFact :: forall a prog. (Fact a, ContainsOutputFact prog a, Eq a)
            => Handle prog -> a -> SouffleM (Maybe a)
-  findFact prog fact = do
-    facts :: [a] <- getFacts prog
-    pure $ List.find (== fact) facts
+  findFact h fact = liftIO $ do
+    let relationName = factName (Proxy :: Proxy a)
+    output <- lookupOutput h relationName
+    index <- case cachedIndex output of
+      Just index -> pure index
+      Nothing -> do
+        facts :: [a] <- parseCSV $ cachedContents output
+        let index = Set.fromList $ mapMaybe serializeFact facts
+            output' = output { cachedIndex = Just index }
+        modifyIORef' (outputCache h) $ Map.insert relationName output'
+        pure index
+    pure $ case serializeFact fact of
+      Just line | Set.member line index -> Just fact
+      _ -> Nothing
   {-# INLINABLE findFact #-}
 
   addFact :: forall a prog. (Fact a, ContainsInputFact prog a, Marshal a)
           => Handle prog -> a -> SouffleM ()
   addFact h fact = liftIO $ do
-    handle <- readIORef $ handleData h
     let relationName = factName (Proxy :: Proxy a)
-    let factFile = factPath handle </> relationName <.> "facts"
-    let line = pushMarshalT (push fact)
-    appendFile factFile $ List.intercalate "\t" line ++ "\n"
+    writeFacts h relationName [fact]
   {-# INLINABLE addFact #-}
 
   addFacts :: forall a prog f. (Fact a, ContainsInputFact prog a, Marshal a, Foldable f)
            => Handle prog -> f a -> SouffleM ()
   addFacts h facts = liftIO $ do
-    handle <- readIORef $ handleData h
     let relationName = factName (Proxy :: Proxy a)
-    let factFile = factPath handle </> relationName <.> "facts"
-    let factLines = map (pushMarshalT . push) (foldMap pure facts)
-    traverse_ (\line -> appendFile factFile (List.intercalate "\t" line ++ "\n")) factLines
+    writeFacts h relationName facts
   {-# INLINABLE addFacts #-}
 
 datalogProgramFile :: forall prog. Program prog => prog -> FilePath -> IO (Maybe FilePath)
@@ -363,6 +703,38 @@ datalogProgramFile prog datalogDir = do
     True -> pure $ Just dlFile
 {-# INLINABLE datalogProgramFile #-}
 
+{- | Compiles a datalog program to a native executable (using @souffle -o@),
+     and stores it in the cache directory. If the cache already contains an
+     executable for the same program and souffle version, that one is reused.
+
+     Returns the path to the compiled executable.
+-}
+compileCached :: FilePath -> FilePath -> FilePath -> IO FilePath
+compileCached souffleBin datalogFile cacheDir = do
+  createDirectoryIfMissing True cacheDir
+  program <- BS.readFile datalogFile
+  version <- readProcess souffleBin ["--version"] ""
+  let key = fnv1a $ BSL.fromStrict $ program <> BS8.pack version
+      executable = cacheDir </> printf "%s-%016x" (takeBaseName datalogFile) key
+  doesFileExist executable >>= \case
+    True -> pure executable
+    False -> do
+      -- NOTE: compile in a separate directory and move the result afterwards,
+      -- so concurrent compilations never observe a partially written file.
+      withTempDirectory cacheDir "compile" $ \compileDir -> do
+        let tmpExecutable = compileDir </> takeBaseName datalogFile
+        callProcess souffleBin ["-o", tmpExecutable, datalogFile]
+        renameFile tmpExecutable executable
+      pure executable
+{-# INLINABLE compileCached #-}
+
+-- | 64-bit FNV-1a hash, used as a cache key for compiled programs and for
+--   detecting changes in input facts.
+fnv1a :: BSL.ByteString -> Word64
+fnv1a = BSL.foldl' step 14695981039346656037
+  where step h byte = (h `xor` fromIntegral byte) * 1099511628211
+{-# INLINABLE fnv1a #-}
+
 locateSouffle :: IO (Maybe FilePath)
 locateSouffle = do
   let locateCmd = (shell "which souffle") { std_out = CreatePipe }
@@ -376,14 +748,47 @@ locateSouffle = do
         _ -> pure Nothing
 {-# INLINABLE locateSouffle #-}
 
-readCSVFile :: FilePath -> IO [[String]]
-readCSVFile path = doesFileExist path >>= \case
-  False -> pure []
-  True -> do
-    contents <- readFile path
-    -- deepseq needed to avoid issues with lazy IO
-    pure $ contents `deepseq` (map (splitOn '\t') . lines) contents
-{-# INLINABLE readCSVFile #-}
+{- | Parses all facts from the contents of a .csv file written by Souffle.
+
+     Each line is parsed without any intermediate 'String' values. For large
+     files, the lines are split in chunks that are parsed in parallel (one per
+     capability), so this only runs in parallel when the RTS is started with
+     multiple capabilities (e.g. @+RTS -N@).
+-}
+parseCSV :: forall a. Marshal a => BS.ByteString -> IO [a]
+parseCSV contents = do
+  capabilities <- getNumCapabilities
+  if capabilities == 1 || BS.length contents < parallelThreshold
+    then evaluate $ parseCSVChunk contents
+    else do
+      results <- forM (splitChunks capabilities contents) $ \chunk -> do
+        result <- newEmptyMVar
+        _ <- forkIO $ putMVar result =<< try (evaluate $ parseCSVChunk chunk)
+        pure result
+      facts :: [Either SomeException [a]] <- traverse takeMVar results
+      concat <$> traverse (either throwIO pure) facts
+  where parallelThreshold = 1024 * 1024
+{-# INLINABLE parseCSV #-}
+
+-- | Parses all facts in a chunk of a .csv file. Each fact is evaluated
+--   to WHNF once the resulting list is evaluated.
+parseCSVChunk :: Marshal a => BS.ByteString -> [a]
+parseCSVChunk chunk =
+  let facts = map (popMarshalT pop) $ BS8.lines chunk
+   in foldr seq () facts `seq` facts
+{-# INLINABLE parseCSVChunk #-}
+
+-- | Splits a .csv file in (approximately) equal chunks, on line boundaries.
+splitChunks :: Int -> BS.ByteString -> [BS.ByteString]
+splitChunks chunkCount contents = go contents where
+  chunkSize = BS.length contents `div` chunkCount + 1
+  go bs
+    | BS.null bs = []
+    | otherwise =
+      let (before, after) = BS.splitAt chunkSize bs
+          (rest, after') = BS8.break (== '\n') after
+       in BS.append before rest : go (BS.drop 1 after')
+{-# INLINABLE splitChunks #-}
 
 -- | Returns the handle of stdout from the souffle interpreter.
 souffleStdOut :: forall prog. Program prog => Handle prog -> SouffleM (Maybe T.Text)
@@ -393,9 +798,3 @@ souffleStdOut = liftIO . readIORef . stdoutResult
 souffleStdErr :: forall prog. Program prog => Handle prog -> SouffleM (Maybe T.Text)
 souffleStdErr = liftIO . readIORef . stderrResult
 
-splitOn :: Char -> String -> [String]
-splitOn c s =
-  let (x, rest) = break (== c) s
-      rest' = drop 1 rest
-   in x : splitOn c rest'
-{-# INLINABLE splitOn #-}
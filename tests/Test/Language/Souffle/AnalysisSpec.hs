@@ -126,6 +126,22 @@ spec = describe "composing analyses" $ parallel $ do
       results <- execAnalysis analysis inputs
       liftIO $ results `shouldBe` Results reachables inputs
 
+  it "supports running independent analyses concurrently" $
+    withSouffle Path $ \hPath1 -> withSouffle Path $ \hPath2 -> do
+      let analysis1 = mkAnalysisWithThreads (Souffle.addFacts hPath1) (Souffle.setNumThreads hPath1)
+                                            (Souffle.run hPath1) (Souffle.getFacts hPath1)
+          analysis2 = pathAnalysis' hPath2
+          analysis = Results <$> analysis1 <*> analysis2
+          inputs = [Edge "a" "b", Edge "b" "c"]
+          reachables = [ Reachable "a" "b"
+                       , Reachable "a" "c"
+                       , Reachable "b" "c"
+                       ]
+      results <- execAnalysisConcurrently Souffle.runConcurrently 4 analysis inputs
+      threadCount <- Souffle.getNumThreads hPath1
+      liftIO $ results `shouldBe` Results reachables inputs
+      liftIO $ threadCount `shouldBe` 2
+
   it "supports semigroupal composition" $ do
     withSouffle Path $ \h -> do
       let analysis = pathAnalysis h
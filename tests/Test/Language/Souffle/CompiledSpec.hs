@@ -6,9 +6,17 @@ module Test.Language.Souffle.CompiledSpec
 
 import Test.Hspec
 import GHC.Generics
+import Control.Exception (ErrorCall, try)
+import Control.Monad (when)
+import Control.Monad.IO.Class
+import Data.Either
 import Data.Maybe
+import Data.Proxy
+import Data.Int
+import Foreign.Storable
 import qualified Data.Array as A
 import qualified Data.Vector as V
+import qualified Data.Vector.Storable as SV
 import qualified Language.Souffle.Compiled as Souffle
 
 data Path = Path
@@ -35,6 +43,29 @@ instance Souffle.Marshal Edge
 instance Souffle.Marshal Reachable
 
 
+-- | Same relation as Reachable, but fails to unmarshal facts ending in "d".
+data FailingReachable = FailingReachable String String
+  deriving stock (Eq, Show)
+
+instance Souffle.Fact FailingReachable where
+  type FactDirection FailingReachable = 'Souffle.Output
+  factName = const "reachable"
+
+instance Souffle.Marshal FailingReachable where
+  push (FailingReachable a b) = Souffle.push a >> Souffle.push b
+  pop = do
+    a <- Souffle.pop
+    b <- Souffle.pop
+    when (b == "d") $ error "failed to unmarshal fact"
+    pure $ FailingReachable a b
+
+data PathFailing = PathFailing
+
+instance Souffle.Program PathFailing where
+  type ProgramFacts PathFailing = '[Edge, Reachable, FailingReachable]
+  programName = const "path"
+
+
 data BadPath = BadPath
 
 instance Souffle.Program BadPath where
@@ -42,6 +73,34 @@ instance Souffle.Program BadPath where
   programName = const "bad_path"
 
 
+data RoundTrip = RoundTrip
+
+data LargeRecord = LargeRecord Int32 Int32 Int32 Int32
+  deriving stock (Eq, Show, Generic)
+
+instance Souffle.Program RoundTrip where
+  type ProgramFacts RoundTrip = '[LargeRecord]
+  programName = const "round_trip"
+
+instance Souffle.Fact LargeRecord where
+  type FactDirection LargeRecord = 'Souffle.InputOutput
+  factName = const "large_record"
+
+instance Souffle.Marshal LargeRecord
+
+instance Storable LargeRecord where
+  sizeOf = const 16
+  alignment = const 4
+  peek ptr =
+    LargeRecord <$> peekByteOff ptr 0 <*> peekByteOff ptr 4
+                <*> peekByteOff ptr 8 <*> peekByteOff ptr 12
+  poke ptr (LargeRecord a b c d) = do
+    pokeByteOff ptr 0 a
+    pokeByteOff ptr 4 b
+    pokeByteOff ptr 8 c
+    pokeByteOff ptr 12 d
+
+
 spec :: Spec
 spec = describe "Souffle API" $ parallel $ do
   describe "init" $ parallel $ do
@@ -111,6 +170,93 @@ spec = describe "Souffle API" $ parallel $ do
         Souffle.getFacts prog
       edges `shouldBe` ([] :: [Edge])
 
+  describe "getFactsCached" $ parallel $ do
+    it "returns the same facts as getFacts" $ do
+      (edges, reachables) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        es <- Souffle.getFactsCached prog
+        rs <- Souffle.getFactsCached prog
+        pure (es , rs)
+      edges `shouldBe` [Edge "b" "c", Edge "a" "b"]
+      reachables `shouldBe` V.fromList [Reachable "a" "b", Reachable "a" "c", Reachable "b" "c"]
+
+    it "can retrieve facts containing previously seen symbols" $ do
+      (edges1, edges2) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        es1 <- Souffle.getFactsCached prog
+        Souffle.addFacts prog [Edge "c" "a", Edge "" "d"]
+        es2 <- Souffle.getFactsCached prog
+        pure (es1, es2)
+      edges1 `shouldBe` [Edge "b" "c", Edge "a" "b"]
+      edges2 `shouldMatchList` [Edge "" "d", Edge "a" "b", Edge "b" "c", Edge "c" "a"]
+
+    it "returns new symbols after running the program again" $ do
+      (reachables1, reachables2) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        rs1 <- Souffle.getFactsCached prog
+        Souffle.addFacts prog [Edge "c" "d", Edge "e" "a"]
+        Souffle.run prog
+        rs2 <- Souffle.getFactsCached prog
+        pure (rs1, rs2)
+      reachables1 `shouldMatchList` [Reachable "a" "b", Reachable "a" "c", Reachable "b" "c"]
+      reachables2 `shouldMatchList`
+        [ Reachable "a" "b", Reachable "a" "c", Reachable "a" "d"
+        , Reachable "b" "c", Reachable "b" "d", Reachable "c" "d"
+        , Reachable "e" "a", Reachable "e" "b", Reachable "e" "c", Reachable "e" "d" ]
+
+    it "keeps the symbol cache consistent if unmarshalling fails" $ do
+      -- NOTE: the handle is reused across multiple calls to runSouffle, so
+      -- the exception can be caught in between.
+      prog <- fromJust <$> Souffle.runSouffle PathFailing pure
+      let exec :: Souffle.SouffleM b -> IO b
+          exec = Souffle.runSouffle PathFailing . const
+      exec $ do
+        Souffle.run prog
+        _ :: [Reachable] <- Souffle.getFactsCached prog
+        Souffle.addFact prog $ Edge "c" "d"
+        Souffle.run prog
+      result :: Either ErrorCall [FailingReachable] <- try $ exec $ Souffle.getFactsCached prog
+      result `shouldSatisfy` isLeft
+      reachables <- exec $ Souffle.getFactsCached prog
+      reachables `shouldMatchList`
+        [ Reachable "a" "b", Reachable "a" "c", Reachable "a" "d"
+        , Reachable "b" "c", Reachable "b" "d", Reachable "c" "d" ]
+
+  describe "getFactsStorable" $ parallel $ do
+    it "copies facts directly into a storable vector" $ do
+      records <- Souffle.runSouffle RoundTrip $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFacts prog [LargeRecord 5 6 7 8, LargeRecord 1 2 3 4]
+        Souffle.getFactsStorable prog
+      records `shouldBe` SV.fromList [LargeRecord 1 2 3 4, LargeRecord 5 6 7 8]
+
+    it "returns an empty vector if there are no facts" $ do
+      records <- Souffle.runSouffle RoundTrip $ \handle ->
+        Souffle.getFactsStorable (fromJust handle)
+      records `shouldBe` (SV.empty :: SV.Vector LargeRecord)
+
+  describe "fixed layout marshalling" $ parallel $ do
+    it "round trips facts using the fixed layout" $ do
+      records <- Souffle.runSouffle RoundTrip $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFactsFixed prog [LargeRecord 5 6 7 8, LargeRecord 1 2 3 4]
+        Souffle.getFactsFixed prog
+      records `shouldBe` V.fromList [LargeRecord 1 2 3 4, LargeRecord 5 6 7 8]
+
+    it "is compatible with the generic marshalling" $ do
+      (records1, records2) <- Souffle.runSouffle RoundTrip $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFactsFixed prog [LargeRecord 1 2 3 4]
+        records1 <- Souffle.getFacts prog
+        Souffle.addFacts prog [LargeRecord (-1) 0 1 2]
+        records2 <- Souffle.getFactsFixed prog
+        pure (records1, records2)
+      records1 `shouldBe` [LargeRecord 1 2 3 4]
+      records2 `shouldBe` V.fromList [LargeRecord (-1) 0 1 2, LargeRecord 1 2 3 4]
+
   describe "addFact" $ parallel $
     it "adds a fact" $ do
       (edgesBefore, edgesAfter) <- Souffle.runSouffle Path $ \handle -> do
@@ -137,6 +283,55 @@ spec = describe "Souffle API" $ parallel $ do
       edgesBefore `shouldBe` [Edge "b" "c", Edge "a" "b"]
       edgesAfter `shouldBe` [Edge "f" "g", Edge "e" "f", Edge "b" "c", Edge "a" "b"]
 
+  describe "addFactsParallel / getFactsParallel" $ parallel $
+    it "can add and retrieve many facts at once" $ do
+      let edges = [Edge (show i) (show (i + 1)) | i <- [1 .. 100 :: Int]]
+      (edgesAfter, reachables) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFactsParallel prog edges
+        Souffle.run prog
+        (,) <$> Souffle.getFactsParallel prog <*> Souffle.getFacts prog
+      V.length edgesAfter `shouldBe` 102
+      V.toList edgesAfter `shouldMatchList` (Edge "a" "b" : Edge "b" "c" : edges)
+      V.length (reachables :: V.Vector Reachable) `shouldBe` 5053
+
+  describe "addFactsPipelined" $ parallel $
+    it "adds all facts, regardless of the chunk size" $ do
+      let edges = [Edge (show i) (show (i + 1)) | i <- [1 .. 100 :: Int]]
+      (edgesAfter, reachables) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFactsPipelined prog 7 edges
+        Souffle.run prog
+        (,) <$> Souffle.getFacts prog <*> Souffle.getFacts prog
+      V.toList edgesAfter `shouldMatchList` (Edge "a" "b" : Edge "b" "c" : edges)
+      V.length (reachables :: V.Vector Reachable) `shouldBe` 5053
+
+  describe "getFactsDiff" $ parallel $
+    it "returns the facts that were added and removed" $ do
+      (added, removed) <- Souffle.runSouffle Path $ \handle1 -> do
+        let prog1 = fromJust handle1
+        Souffle.addFact prog1 $ Edge "c" "d"
+        Souffle.run prog1
+        liftIO $ Souffle.runSouffle Path $ \handle2 -> do
+          let prog2 = fromJust handle2
+          Souffle.addFact prog2 $ Edge "b" "e"
+          Souffle.run prog2
+          Souffle.getFactsDiff prog1 prog2
+      added `shouldMatchList` [Reachable "a" "e", Reachable "b" "e"]
+      removed `shouldMatchList` [Reachable "a" "d", Reachable "b" "d", Reachable "c" "d"]
+
+  describe "getFactsDiffSince" $ parallel $
+    it "returns the facts that changed since a snapshot" $ do
+      (added, removed) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        snapshot <- Souffle.snapshotFacts prog (Proxy :: Proxy Reachable)
+        Souffle.addFact prog $ Edge "c" "d"
+        Souffle.run prog
+        Souffle.getFactsDiffSince prog snapshot
+      added `shouldMatchList` [Reachable "a" "d", Reachable "b" "d", Reachable "c" "d"]
+      removed `shouldBe` []
+
   describe "run" $ parallel $ do
     it "is OK to run a program multiple times" $ do
       edges <- Souffle.runSouffle Path $ \handle -> do
@@ -205,6 +400,67 @@ spec = describe "Souffle API" $ parallel $ do
              <*> Souffle.findFact prog fact3
       results `shouldBe` (Just fact, Nothing, Nothing)
 
+    it "finds facts when using a Bloom filter" $ do
+      results <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.useBloomFilter prog (Proxy :: Proxy Edge) True
+        Souffle.run prog
+        r1 <- Souffle.findFact prog $ Edge "a" "b"
+        r2 <- Souffle.findFact prog $ Edge "c" "a"
+        Souffle.addFact prog $ Edge "c" "a"
+        r3 <- Souffle.findFact prog $ Edge "c" "a"
+        pure (r1, r2, r3)
+      results `shouldBe` ( Just (Edge "a" "b")
+                         , Nothing
+                         , Just (Edge "c" "a") )
+
+  describe "freezeRelation" $ parallel $ do
+    it "returns the same facts after freezing a relation" $ do
+      (reachables, r1, r2) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        Souffle.freezeRelation prog (Proxy :: Proxy Reachable)
+        (,,) <$> Souffle.getFacts prog
+             <*> Souffle.findFact prog (Reachable "a" "c")
+             <*> Souffle.findFact prog (Reachable "c" "a")
+      reachables `shouldBe` [Reachable "b" "c", Reachable "a" "c", Reachable "a" "b"]
+      r1 `shouldBe` Just (Reachable "a" "c")
+      r2 `shouldBe` Nothing
+
+    it "discards the frozen relation when facts are added" $ do
+      edges <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        Souffle.freezeRelation prog (Proxy :: Proxy Edge)
+        Souffle.addFact prog $ Edge "c" "d"
+        Souffle.getFacts prog
+      edges `shouldBe` [Edge "c" "d", Edge "b" "c", Edge "a" "b"]
+
+  describe "getFactsRange" $ parallel $
+    it "returns the facts in the requested range" $ do
+      (r1, r2, r3) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        (,,) <$> Souffle.getFactsRange prog 1 1
+             <*> Souffle.getFactsRange prog 1 10
+             <*> Souffle.getFactsRange prog 5 1
+      r1 `shouldBe` V.fromList [Reachable "a" "c"]
+      r2 `shouldBe` V.fromList [Reachable "a" "c", Reachable "b" "c"]
+      r3 `shouldBe` V.empty
+
+  describe "getFactsSample" $ parallel $
+    it "returns a sample of distinct facts" $ do
+      (s1, s2, s3) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        (,,) <$> Souffle.getFactsSample prog 2 42
+             <*> Souffle.getFactsSample prog 2 42
+             <*> Souffle.getFactsSample prog 10 42
+      V.length (s1 :: V.Vector Reachable) `shouldBe` 2
+      V.uniq s1 `shouldBe` s1
+      s2 `shouldBe` s1
+      s3 `shouldBe` V.fromList [Reachable "a" "b", Reachable "a" "c", Reachable "b" "c"]
+
   -- TODO writeFiles / loadFiles
 
   describe "Semigroup and Monoid instances" $ parallel $ do
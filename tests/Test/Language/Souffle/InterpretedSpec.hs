@@ -8,7 +8,11 @@ module Test.Language.Souffle.InterpretedSpec
 import Test.Hspec
 import GHC.Generics
 import Data.Maybe
+import Data.Proxy
+import Control.Concurrent (threadDelay)
+import Control.Exception (ErrorCall(..), throwIO)
 import Control.Monad.IO.Class (liftIO)
+import Data.IORef
 import System.Directory
 import System.IO.Temp
 import qualified Data.Array as A
@@ -140,7 +144,7 @@ spec = describe "Souffle API" $ parallel $ do
           edges `shouldBe` [Edge "a" "b", Edge "b" "c", Edge "e" "f"]
           length entries `shouldNotBe` 0
 
-  describe "addFacts" $ parallel $
+  describe "addFacts" $ parallel $ do
     it "can add multiple facts at once" $ do
       edges <- Souffle.runSouffle Path $ \handle -> do
         let prog = fromJust handle
@@ -149,7 +153,99 @@ spec = describe "Souffle API" $ parallel $ do
         Souffle.getFacts prog
       edges `shouldBe` [Edge "a" "b", Edge "b" "c", Edge "e" "f", Edge "f" "g"]
 
+    it "can add facts in multiple batches" $ do
+      edges <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFacts prog [Edge "e" "f"]
+        Souffle.addFacts prog [Edge "f" "g", Edge "g" "h"]
+        Souffle.run prog
+        Souffle.getFacts prog
+      edges `shouldBe` [Edge "a" "b", Edge "b" "c", Edge "e" "f", Edge "f" "g", Edge "g" "h"]
+
+    it "can stream facts to souffle using named pipes" $ do
+      cfg <- Souffle.defaultConfig
+      let cfg' = cfg { Souffle.cfgStreamFacts = True }
+      (edges1, edges2) <- Souffle.runSouffleWith cfg' Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFacts prog [Edge "e" "f", Edge "f" "g"]
+        Souffle.run prog
+        es1 <- Souffle.getFacts prog
+        Souffle.addFact prog $ Edge "g" "h"
+        Souffle.run prog
+        es2 <- Souffle.getFacts prog
+        pure (es1, es2)
+      edges1 `shouldBe` [Edge "a" "b", Edge "b" "c", Edge "e" "f", Edge "f" "g"]
+      edges2 `shouldBe` [Edge "a" "b", Edge "b" "c", Edge "e" "f", Edge "f" "g", Edge "g" "h"]
+
+    it "derives facts from facts streamed using named pipes" $ do
+      cfg <- Souffle.defaultConfig
+      let cfg' = cfg { Souffle.cfgStreamFacts = True }
+      reachables <- Souffle.runSouffleWith cfg' Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFacts prog [Edge "c" "d", Edge "d" "e"]
+        Souffle.run prog
+        Souffle.getFacts prog
+      reachables `shouldMatchList`
+        [ Reachable "a" "b", Reachable "a" "c", Reachable "a" "d", Reachable "a" "e"
+        , Reachable "b" "c", Reachable "b" "d", Reachable "b" "e"
+        , Reachable "c" "d", Reachable "c" "e", Reachable "d" "e" ]
+
+    it "throws an exception for symbols containing tabs" $ do
+      let action = Souffle.runSouffle Path $ \handle ->
+            Souffle.addFacts (fromJust handle) [Edge "e\tf" "g"]
+      action `shouldThrow` (== Souffle.UnsupportedSymbol "e\tf")
+
+    it "does not write any facts if one of them contains a tab" $ do
+      cfg <- Souffle.defaultConfig
+      tmp <- getTestTemporaryDirectory
+      let cfg' = cfg { Souffle.cfgFactDir = Just tmp }
+          action = Souffle.runSouffleWith cfg' Path $ \handle ->
+            Souffle.addFacts (fromJust handle) [Edge "e" "f", Edge "f\tg" "h"]
+      action `shouldThrow` (== Souffle.UnsupportedSymbol "f\tg")
+      listDirectory tmp `shouldReturn` []
+
+  describe "replaceFacts" $ parallel $ do
+    it "replaces all facts of a relation" $ do
+      (edges1, edges2) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.replaceFacts prog [Edge "e" "f", Edge "f" "g"]
+        Souffle.run prog
+        es1 <- Souffle.getFacts prog
+        Souffle.replaceFacts prog [Edge "f" "g"]
+        Souffle.run prog
+        es2 <- Souffle.getFacts prog
+        pure (es1, es2)
+      edges1 `shouldBe` [Edge "a" "b", Edge "b" "c", Edge "e" "f", Edge "f" "g"]
+      edges2 `shouldBe` [Edge "a" "b", Edge "b" "c", Edge "f" "g"]
+
+    it "can clear all facts of a relation" $ do
+      edges <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.addFacts prog [Edge "e" "f", Edge "f" "g"]
+        Souffle.clearFacts prog (Proxy :: Proxy Edge)
+        Souffle.run prog
+        Souffle.getFacts prog
+      edges `shouldBe` [Edge "a" "b", Edge "b" "c"]
+
   describe "run" $ parallel $ do
+    it "can run a compiled and cached version of a program" $ do
+      cfg <- Souffle.defaultConfig
+      tmp <- getTestTemporaryDirectory
+      let cfg' = cfg { Souffle.cfgCompileCache = Just tmp }
+          action = Souffle.runSouffleWith cfg' Path $ \handle -> do
+            let prog = fromJust handle
+            Souffle.addFact prog $ Edge "c" "d"
+            Souffle.run prog
+            Souffle.getFacts prog
+      reachables1 <- action
+      cachedFiles <- listDirectory tmp
+      reachables2 <- action
+      cachedFiles' <- listDirectory tmp
+      reachables1 `shouldBe` reachables2
+      reachables1 `shouldContain` [Reachable "a" "d"]
+      length cachedFiles `shouldBe` 1
+      cachedFiles' `shouldBe` cachedFiles
+
     it "is OK to run a program multiple times" $ do
       edges <- Souffle.runSouffle PathNoInput $ \handle -> do
         let prog = fromJust handle
@@ -186,6 +282,15 @@ spec = describe "Souffle API" $ parallel $ do
       stdout `shouldBe` Just ""
       stderr `shouldBe` Just ""
 
+  describe "runConcurrently" $ parallel $
+    it "waits for all actions before rethrowing an exception" $ do
+      finished <- newIORef False
+      let slow = liftIO $ threadDelay 100000 >> writeIORef finished True
+          failing = liftIO $ throwIO $ ErrorCall "failed"
+      Souffle.runSouffle Path (const $ Souffle.runConcurrently [failing, slow])
+        `shouldThrow` errorCall "failed"
+      readIORef finished `shouldReturn` True
+
   describe "configuring number of cores" $ parallel $
     it "is possible to configure number of cores" $ do
       results <- Souffle.runSouffle Path $ \handle -> do
@@ -219,6 +324,18 @@ spec = describe "Souffle API" $ parallel $ do
       edge `shouldBe` Just (Edge "a" "b")
       reachable `shouldBe` Just (Reachable "a" "c")
 
+    it "takes new facts into account after running again" $ do
+      (before, after) <- Souffle.runSouffle Path $ \handle -> do
+        let prog = fromJust handle
+        Souffle.run prog
+        r1 <- Souffle.findFact prog $ Reachable "a" "d"
+        Souffle.addFact prog $ Edge "c" "d"
+        Souffle.run prog
+        r2 <- Souffle.findFact prog $ Reachable "a" "d"
+        pure (r1, r2)
+      before `shouldBe` Nothing
+      after `shouldBe` Just (Reachable "a" "d")
+
   describe "Semigroup and Monoid instances" $ parallel $ do
     it "combines Souffle actions into one using (<>)" $ do
       edges <- Souffle.runSouffle Path $ \handle -> do